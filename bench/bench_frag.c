@@ -0,0 +1,130 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Compare l'occupation mémoire du buddy, du Circular First Fit, du buddy
+ * pondéré et du Best Fit.
+ *
+ * Pour chaque loi de tailles, on alloue et libère au hasard (avec plus
+ * d'allocations que de libérations) dans un pool de POOL_SIZE octets, jusqu'à
+ * la première allocation qui échoue. On note alors les octets demandés par
+ * les blocs vivants, rapportés à la taille du pool : c'est la part du pool
+ * réellement utile quand l'allocateur ne peut plus servir. La différence
+ * vient de l'arrondi des tailles (puissance de 2 pour le buddy, puissance de
+ * 2 ou ses trois quarts pour le buddy pondéré, 32 octets pour CFF et 16 pour
+ * BF) et de la fragmentation externe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/mem.h"
+#include "../src/mem_cff.h"
+#include "../src/mem_wbuddy.h"
+#include "../src/mem_bf.h"
+
+#define POOL_SIZE (1UL << 20)
+#define NB_SLOTS 65536
+#define NB_RUNS 20
+
+struct engine {
+    const char *name;
+    int (*init)();
+    void *(*alloc)(unsigned long);
+    int (*free)(void *, unsigned long);
+    int (*destroy)();
+};
+
+static int buddy_init() { return mem_init_ex(POOL_SIZE, 0); }
+static int cff_init_pool() { return cff_init(POOL_SIZE); }
+static int wbuddy_init_pool() { return wbuddy_init(POOL_SIZE); }
+static int bf_init_pool() { return bf_init(POOL_SIZE); }
+
+static struct engine engines[] = {
+    { "buddy", buddy_init, mem_alloc, mem_free, mem_destroy },
+    { "cff", cff_init_pool, cff_alloc, cff_free, cff_destroy },
+    { "wbuddy", wbuddy_init_pool, wbuddy_alloc, wbuddy_free, wbuddy_destroy },
+    { "bf", bf_init_pool, bf_alloc, bf_free, bf_destroy },
+};
+
+// Lois de tailles
+static unsigned long small(unsigned int *seed)
+{
+    return 1 + rand_r(seed) % 256;
+}
+
+static unsigned long uniform(unsigned int *seed)
+{
+    return 1 + rand_r(seed) % 8192;
+}
+
+// Juste au-dessus d'une puissance de 2 : le pire cas du buddy
+static unsigned long above_pow2(unsigned int *seed)
+{
+    return (1UL << (6 + rand_r(seed) % 7)) + 1 + rand_r(seed) % 64;
+}
+
+static struct {
+    const char *name;
+    unsigned long (*size)(unsigned int *);
+} laws[] = {
+    { "1-256", small },
+    { "1-8192", uniform },
+    { "2^k+1..64", above_pow2 },
+};
+
+static void *adr[NB_SLOTS];
+static unsigned long len[NB_SLOTS];
+
+// Retourne la part du pool occupée par des octets demandés au premier échec
+static double run(struct engine *e, unsigned long (*law)(unsigned int *),
+                  unsigned int seed)
+{
+    unsigned long live = 0;
+    double res = 0;
+
+    e->init();
+    for (int i = 0; i < NB_SLOTS; i++) {
+        adr[i] = 0;
+    }
+    for (;;) {
+        int k = rand_r(&seed) % NB_SLOTS;
+        if (adr[k] && rand_r(&seed) % 3 == 0) {
+            e->free(adr[k], len[k]);
+            live -= len[k];
+            adr[k] = 0;
+        } else if (!adr[k]) {
+            len[k] = law(&seed);
+            if ((adr[k] = e->alloc(len[k])) == 0) {
+                res = (double) live / POOL_SIZE;
+                break;
+            }
+            live += len[k];
+        }
+    }
+    e->destroy();
+    return res;
+}
+
+int main()
+{
+    printf("%-12s", "tailles");
+    for (unsigned int j = 0; j < sizeof(engines) / sizeof(engines[0]); j++) {
+        printf(" %10s", engines[j].name);
+    }
+    printf("\n");
+    for (unsigned int l = 0; l < sizeof(laws) / sizeof(laws[0]); l++) {
+        printf("%-12s", laws[l].name);
+        for (unsigned int j = 0; j < sizeof(engines) / sizeof(engines[0]); j++) {
+            double sum = 0;
+            for (unsigned int r = 0; r < NB_RUNS; r++) {
+                sum += run(&engines[j], laws[l].size, r + 1);
+            }
+            printf(" %9.1f%%", 100 * sum / NB_RUNS);
+        }
+        printf("\n");
+    }
+    return 0;
+}
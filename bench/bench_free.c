@@ -0,0 +1,75 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Mesure la latence de mem_free en fonction de la longueur de la liste des
+ * blocs libres de même taille.
+ *
+ * Pour chaque longueur n, on alloue 2n blocs de BLOC_SIZE octets et on libère
+ * un bloc sur deux : la liste de taille BLOC_SIZE contient alors n blocs dont
+ * aucun compagnon n'est libre. On mesure ensuite la libération des n autres
+ * blocs, qui fusionnent chacun avec un compagnon situé n'importe où dans la
+ * liste. Avec des listes doublement chainées, le temps par libération doit
+ * rester constant quand n augmente.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/mem.h"
+
+#define BLOC_SIZE 16
+#define NB_FREE 1000000
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+    unsigned long n;
+    unsigned long max = ALLOC_MEM_SIZE / (2 * BLOC_SIZE);
+    void **tab = malloc(2 * max * sizeof(void *));
+
+    printf("%10s %10s\n", "libres", "ns/free");
+    for (n = 16; n <= max; n *= 2) {
+        unsigned long i, r;
+        unsigned long nb_repeat = NB_FREE / n + 1;
+        double total = 0;
+
+        for (r = 0; r < nb_repeat; r++) {
+            double start;
+
+            if (mem_init() != 0) {
+                fprintf(stderr, "mem_init a echoue\n");
+                return 1;
+            }
+            for (i = 0; i < 2 * n; i++) {
+                tab[i] = mem_alloc(BLOC_SIZE);
+                if (tab[i] == 0) {
+                    fprintf(stderr, "mem_alloc a echoue\n");
+                    return 1;
+                }
+            }
+            for (i = 0; i < 2 * n; i += 2) {
+                mem_free(tab[i], BLOC_SIZE);
+            }
+
+            start = now_ns();
+            for (i = 1; i < 2 * n; i += 2) {
+                mem_free(tab[i], BLOC_SIZE);
+            }
+            total += now_ns() - start;
+            mem_destroy();
+        }
+        printf("%10lu %10.1f\n", n, total / (nb_repeat * n));
+    }
+    free(tab);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Micro-benchmark de get_index sur toute la plage des tailles allouables
+ * (1 à ALLOC_MEM_SIZE octets), comparé à l'ancienne version qui bouclait sur
+ * les puissances de 2. Les résultats des deux versions sont aussi comparés.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/mem.h"
+
+// Exportée par mem.c mais absente de mem.h
+int get_index(unsigned long size);
+
+#define NB_PASS 20
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int get_index_boucle(unsigned long size)
+{
+    int index;
+    for (index = 0; (1UL << index) < size; index++) {
+        ;}
+    return index;
+}
+
+int main()
+{
+    unsigned long size;
+    unsigned long nb = 0;
+    volatile int sink = 0;
+    double start, t_clz, t_boucle;
+    int pass;
+
+    for (size = 1; size <= ALLOC_MEM_SIZE; size++) {
+        if (get_index(size) != get_index_boucle(size)) {
+            fprintf(stderr, "get_index(%lu) = %d au lieu de %d\n", size,
+                    get_index(size), get_index_boucle(size));
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    for (pass = 0; pass < NB_PASS; pass++) {
+        for (size = 1; size <= ALLOC_MEM_SIZE; size++) {
+            sink += get_index(size);
+        }
+    }
+    t_clz = now_ns() - start;
+
+    start = now_ns();
+    for (pass = 0; pass < NB_PASS; pass++) {
+        for (size = 1; size <= ALLOC_MEM_SIZE; size++) {
+            sink += get_index_boucle(size);
+        }
+    }
+    t_boucle = now_ns() - start;
+
+    nb = (unsigned long) NB_PASS * ALLOC_MEM_SIZE;
+    printf("get_index (clz)    : %6.2f ns/appel\n", t_clz / nb);
+    printf("get_index (boucle) : %6.2f ns/appel\n", t_boucle / nb);
+    return sink == 0;
+}
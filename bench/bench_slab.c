@@ -0,0 +1,88 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Compare le buddy seul et le buddy avec les slabs (mem_set_slab) sur des
+ * petits objets. Pour chaque taille, on mesure le temps d'un couple
+ * mem_alloc / mem_free dans une boucle qui garde NB_LIVE objets alloués, puis
+ * le nombre d'objets de cette taille que contient le pool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/mem.h"
+
+#define NB_LIVE 1024
+#define NB_OPS 4000000
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Temps moyen d'un couple mem_alloc / mem_free, en ns
+static double pair_ns(unsigned long size)
+{
+    static void *live[NB_LIVE];
+    unsigned long i;
+    double start;
+
+    mem_init();
+    for (i = 0; i < NB_LIVE; i++) {
+        live[i] = mem_alloc(size);
+    }
+    start = now_ns();
+    for (i = 0; i < NB_OPS; i++) {
+        unsigned long k = (i * 2654435761u) % NB_LIVE;
+        mem_free(live[k], size);
+        live[k] = mem_alloc(size);
+    }
+    start = now_ns() - start;
+    mem_destroy();
+    return start / NB_OPS;
+}
+
+// Nombre d'objets de size octets que contient le pool
+static unsigned long capacity(unsigned long size)
+{
+    unsigned long n = 0;
+
+    mem_init();
+    while (mem_alloc(size) != 0) {
+        n++;
+    }
+    mem_destroy();
+    return n;
+}
+
+int main()
+{
+    static const unsigned long sizes[] = { 8, 24, 40, 64, 100, 200, 300, 512 };
+
+    printf("%6s %12s %12s %12s %12s\n", "taille", "ns buddy", "ns slab",
+           "obj buddy", "obj slab");
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double t_buddy, t_slab;
+        unsigned long n_buddy, n_slab;
+
+        mem_set_slab(0);
+        t_buddy = pair_ns(sizes[i]);
+        n_buddy = capacity(sizes[i]);
+        if (mem_set_slab(512) != 0) {
+            fprintf(stderr, "mem_set_slab a echoue\n");
+            return 1;
+        }
+        t_slab = pair_ns(sizes[i]);
+        n_slab = capacity(sizes[i]);
+        printf("%6lu %12.1f %12.1f %12lu %12lu\n", sizes[i], t_buddy, t_slab,
+               n_buddy, n_slab);
+    }
+    mem_set_slab(0);
+    return 0;
+}
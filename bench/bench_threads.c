@@ -0,0 +1,97 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+/*
+ * Débit de mem_alloc/mem_free en mode multi-thread, de 1 à 32 threads, avec
+ * une arène par thread (mem_init_arenas). Chaque thread fait NB_OPS couples
+ * alloc/free sur un petit ensemble de blocs, dont un sur quatre est libéré
+ * par le thread voisin (libération distante).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../src/mem.h"
+
+#define NB_OPS 1000000
+#define NB_SLOTS 32
+#define MAX_THREADS 32
+
+static void *volatile shared[MAX_THREADS];
+static long nb_threads;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+    long num = (long) arg;
+    unsigned int seed = num;
+    void *slots[NB_SLOTS] = { 0 };
+
+    for (long i = 0; i < NB_OPS; i++) {
+        int k = rand_r(&seed) % NB_SLOTS;
+        if (slots[k] != 0) {
+            if (k % 4 == 0) {
+                // Passe le bloc au voisin et libère celui qu'il a laissé
+                void *old = __atomic_exchange_n(&shared[(num + 1) % nb_threads],
+                                                slots[k],
+                                                __ATOMIC_ACQ_REL);
+                if (old != 0) {
+                    mem_free(old, 64);
+                }
+            } else {
+                mem_free(slots[k], 64);
+            }
+        }
+        slots[k] = mem_alloc(64);
+    }
+    for (int k = 0; k < NB_SLOTS; k++) {
+        if (slots[k] != 0) {
+            mem_free(slots[k], 64);
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    double ref = 0;
+
+    printf("%8s %8s %12s %10s\n", "threads", "arenes", "Mops/s", "speedup");
+    for (long nb = 1; nb <= MAX_THREADS; nb *= 2) {
+        pthread_t th[MAX_THREADS];
+        double start, mops;
+
+        if (mem_init_arenas(nb) != 0) {
+            fprintf(stderr, "mem_init_arenas a echoue\n");
+            return 1;
+        }
+        nb_threads = nb;
+        for (long i = 0; i < nb; i++) {
+            shared[i] = 0;
+        }
+        start = now_ns();
+        for (long i = 0; i < nb; i++) {
+            pthread_create(&th[i], 0, worker, (void *) i);
+        }
+        for (long i = 0; i < nb; i++) {
+            pthread_join(th[i], 0);
+        }
+        mops = 2.0 * NB_OPS * nb / ((now_ns() - start) / 1e3);
+        if (nb == 1) {
+            ref = mops;
+        }
+        printf("%8ld %8ld %12.1f %10.2f\n", nb, nb, mops, mops / ref);
+        mem_destroy();
+    }
+    return 0;
+}
@@ -8,12 +8,31 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "mem.h"
+#include "mem_cff.h"
+#include "mem_wbuddy.h"
+#include "mem_bf.h"
+#include "mem_grain.h"
+#include "mem_trace.h"
+
+// Les extensions du buddy (mem_init_ex, mem_init_mt...) restent disponibles
+// dans les autres variantes, avec la taille par défaut du buddy
+#ifndef BUDDY_MAX_INDEX
+#define BUDDY_MAX_INDEX 20
+#endif
+
+// Change d'allocateur, après avoir libéré le pool du précédent (voir plus bas)
+static void select_engine(int strategy);
+static void slab_reset();
 
 //////////////////////////////////////////////////////////////////////////////
 
-// Renvoie 2 à la puissance x
-#define POW_2(x) (1 << (x))
+// Renvoie 2 à la puissance x, sur 64 bits
+#define POW_2(x) ((uint64_t) 1 << (x))
 
 // Renvoie l'index dans le tableau free_bloc du bloc de taille size
 int get_index(unsigned long size);
@@ -21,67 +40,451 @@ int get_index(unsigned long size);
 //////////////////////////////////////////////////////////////////////////////
 
 // Une zone mémoire (voir explications plus bas)
-// La taille minimale alouable est celle d'un pointeur sur un autre bloc.
+// La taille minimale alouable est celle de deux pointeurs sur d'autres blocs.
 union bloc {
-    union bloc *next_record; // Chaine de zone mémoire disponible lorsque la
-                             // zone est non allouée
+    struct {
+        union bloc *next_record; // Chaine de zone mémoire disponible lorsque
+        union bloc *prev_record; // la zone est non allouée (dans les deux sens)
+    };
+    struct {
+        union bloc   *next_remote;  // File des blocs libérés par un autre
+        unsigned long remote_index; // thread que celui de l'arène (voir plus bas)
+    };
+    uint32_t    lf_next;     // Pile sans verrou des petits blocs (voir lf_push)
     void       *data;        // Les données lorsque la zone est allouée
 };
 #define MIN_SIZE_ALLOC sizeof(union bloc)
 
 // L'espace allouable est situé dans le tableau memory_pool, d'une taille de
-// ALLOC_MEM_SIZE octets;
+// pool_size octets (ALLOC_MEM_SIZE par défaut, voir mem_init_ex);
 //
-// Le tableau free_bloc de BUDDY_MAX_INDEX + 1 elements contient des pointeurs sur les zones
-// mémoire libres de taille 2 puissance n (avec 0 <= n <= BUDDY_MAX_INDEX).
+// Le memory_pool est une suite de nb_arenas chunks (un seul hors des modes
+// multi-thread et élastique) de taille T(arena_index). Chaque chunk forme une
+// arène : un buddy indépendant, avec ses propres listes free_bloc. En mode
+// élastique (mem_init_elastic), la place de max_arenas chunks est réservée
+// d'un bloc (pool_reserved octets) mais un chunk n'est projeté en mémoire
+// que quand les précédents sont pleins. L'arène d'une adresse se retrouve
+// donc par un simple décalage (ARENA_OF).
+//
+// Le tableau free_bloc de arena_index + 1 elements contient des pointeurs sur les zones
+// mémoire libres de taille 2 puissance n (avec min_index <= n <= arena_index).
 //
 // Les blocs allouables ont une taille T(n) = 2 puissance n, avec pour
-// minimum MIN_SIZE_ALLOC.
+// minimum T(min_index) >= MIN_SIZE_ALLOC.
 //
-// Les blocs allouables de taille T(n) sont regroupés dans une liste dont le
-// premier élément est free_bloc[n].
+// Les blocs allouables de taille T(n) sont regroupés dans une liste
+// circulaire doublement chainée, dont free_bloc[n] est la sentinelle.
 //
-// Si free_bloc[n] = 0, alors il n'y a pas de blocs de taille T(n) disponible.
-// Si free_bloc[n] = A (avec A une adresse différente de 0), alors le bloc
-// situé à l'adresse A est un bloc prêt à être alloué. De même, si le champ
-// next_record du bloc situé à l'adresse A pointe vers B (avec B != 0), alors
-// le bloc situé à l'adresse B est disponible, et ainsi de suite jusqu'au
-// dernier élément de la chaine (dont le champ next_record == 0).
+// Si free_bloc[n].next_record = &free_bloc[n], alors il n'y a pas de blocs de
+// taille T(n) disponible. Sinon, free_bloc[n].next_record pointe vers un bloc
+// A prêt à être alloué, le champ next_record du bloc A pointe vers le bloc
+// disponible suivant, et ainsi de suite jusqu'à revenir sur la sentinelle.
+// Le champ prev_record fait le même chemin en sens inverse, ce qui permet de
+// retirer un bloc quelconque de sa liste en temps constant.
 //
 // Si un bloc est alloué, alors il ne sera plus présent ni dans le tableau
 // free_bloc, ni dans aucune des sous-chaines. Dans ce cas, seul
 // le champ data du bloc devient utile.
-static uint8_t    *memory_pool = 0;
-//int size_free_bloc();
-static union bloc free_bloc[BUDDY_MAX_INDEX + 1];
+//
+// L'état des blocs est aussi conservé en dehors des blocs eux-mêmes, dans le
+// tableau bloc_tag, qui contient un octet par tranche de T(min_index) octets
+// du memory_pool. L'octet correspondant au début d'un bloc libre de taille
+// T(n) vaut TAG_FREE | n, celui d'un bloc de taille T(n) rendu par mem_alloc
+// vaut TAG_USED | n, tous les autres valent 0. Savoir si le compagnon d'un
+// bloc est libre, et de quelle taille, se fait donc en temps constant, et
+// mem_free_ptr retrouve la taille d'un bloc alloué sans que l'appelant ait à
+// la conserver. Un bloc et son compagnon sont toujours dans la même arène,
+// donc chaque octet TAG_FREE de bloc_tag n'est modifié que sous le verrou
+// d'une seule arène ; l'octet TAG_USED d'un bloc alloué n'est modifié que par
+// le thread qui le possède, par des accès atomiques (voir release_bloc).
+//
+// Un bloc libre de plus d'une page peut aussi être propre (TAG_CLEAN) : ses
+// pages, hormis la première qui porte son chainage, ne sont pas en mémoire,
+// soit qu'elles n'ont jamais été touchées, soit qu'elles ont été rendues au
+// système (voir purge_bloc). Les blocs propres sont chainés en fin de liste
+// et les blocs sales en tête : mem_alloc prend donc de préférence un bloc
+// sale, dont les pages ne provoqueront pas de défaut de page.
+static uint8_t      *memory_pool = 0;
+static uint64_t      pool_size = 0;
+static uint64_t      pool_reserved = 0;
+static int           min_index = 0;
+
+// Options de projection des chunks (voir mem_set_backing et map_chunk)
+static unsigned int  pool_backing = 0;
+static int           pool_hugetlb = 0; // Au moins un chunk en MAP_HUGETLB
+
+#define LF_MAX_INDEX 8
+#define LF_LIMIT 512
+
+struct arena {
+    pthread_mutex_t lock;
+    union bloc     *free_bloc; // arena_index + 1 sentinelles, dans free_lists
+
+    // Le bit n de free_mask vaut 1 si et seulement si la liste free_bloc[n]
+    // n'est pas vide. Il est tenu à jour à chaque ajout et retrait d'un bloc,
+    // ce qui permet de trouver la plus petite liste non vide d'index >= k en
+    // un seul masque suivi d'un comptage des zéros de queue.
+    uint64_t        free_mask;
+
+    // Pile sans verrou des blocs de l'arène libérés par des threads qui n'y
+    // sont pas rattachés (voir remote_push)
+    union bloc     *remote;
+
+    // Piles sans verrou de petits blocs libres non fusionnés (voir lf_push)
+    uint64_t        lf_head[LF_MAX_INDEX + 1];
+    unsigned long   lf_count[LF_MAX_INDEX + 1];
+
+    // Octets hors mémoire des blocs propres, et octets des blocs sales de
+    // taille au moins T(purge_index) (voir mem_set_purge)
+    uint64_t        clean;
+    uint64_t        dirty;
+
+    // Compteurs de mem_stats : blocs libres de chaque taille dans free_bloc,
+    // découpes et fusions
+    unsigned long   nb_free[64];
+    unsigned long   splits;
+    unsigned long   merges;
+} __attribute__((aligned(64)));
+
+#define MAX_ARENAS 64
+static struct arena *arenas = 0;
+static unsigned int  nb_arenas = 1;
+static unsigned int  max_arenas = 1;
+static int           arena_index = BUDDY_MAX_INDEX;
+static union bloc   *free_lists = 0;
+static struct arena *cur_arena = 0; // Chunk courant, en mode mono-thread
+#define ARENA_OF(offset) (&arenas[(offset) >> arena_index])
+#define LIST_EMPTY(a, i) ((a)->free_bloc[i].next_record == &(a)->free_bloc[i])
+
+#define TAG_FREE 0x80
+#define TAG_CLEAN 0x40  // Avec TAG_FREE : bloc libre propre
+#define TAG_USED 0x40   // Sans TAG_FREE : bloc rendu par mem_alloc
+#define TAG_ORDER 0x3f
+#define TAG_INDEX(offset) ((offset) >> min_index)
+static uint8_t    *bloc_tag = 0;
+
+// Mode multi-thread (voir mem_init_arenas plus bas)
+static int             mem_threaded = 0;
+static unsigned long   mem_generation = 0;
+static unsigned int    arena_next = 0;
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Rendu des pages des blocs libres au système (voir mem_set_purge)
+static int           page_index = 12;
+static int           purge_index = 0;   // 0 : pas de purge
+static uint64_t      purge_threshold = 0;
+#define PURGE_ON(i) (purge_index != 0 && (i) >= purge_index)
+
+// Compteurs globaux de mem_stats. En mode multi-thread, chaque thread cumule
+// ses allocations et libérations dans son thread_cache et ne les reporte ici
+// qu'au-delà de STAT_FLUSH octets : stat_used peut alors être en retard, et
+// même un moment négatif.
+#define STAT_FLUSH 65536
+static long          stat_used = 0;
+static long          stat_peak = 0;
+static unsigned long stat_failed = 0;
+
+static void stat_publish(long delta)
+{
+    long used = __atomic_add_fetch(&stat_used, delta, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&stat_peak, __ATOMIC_RELAXED);
+    while (used > peak
+           && !__atomic_compare_exchange_n(&stat_peak, &peak, used, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ;
+    }
+}
 //////////////////////////////////////////////////////////////////////////////
 
-int mem_init()
+// Ajoute le bloc sale b en tête de la liste des blocs libres de taille T(i)
+static void push_bloc(struct arena *a, int i, union bloc *b)
 {
-    if (!memory_pool) {
-        memory_pool = (void *) malloc( ALLOC_MEM_SIZE );
+    b->next_record = a->free_bloc[i].next_record;
+    b->prev_record = &a->free_bloc[i];
+    b->next_record->prev_record = b;
+    a->free_bloc[i].next_record = b;
+    a->free_mask |= (uint64_t) 1 << i;
+    a->nb_free[i]++;
+    bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)] = TAG_FREE | i;
+    if (PURGE_ON(i)) {
+        a->dirty += POW_2(i);
     }
-    if (memory_pool == 0) {
+}
+
+// Ajoute le bloc propre b, de plus d'une page, en queue de la liste des
+// blocs libres de taille T(i)
+static void push_clean(struct arena *a, int i, union bloc *b)
+{
+    b->prev_record = a->free_bloc[i].prev_record;
+    b->next_record = &a->free_bloc[i];
+    b->prev_record->next_record = b;
+    a->free_bloc[i].prev_record = b;
+    a->free_mask |= (uint64_t) 1 << i;
+    a->nb_free[i]++;
+    bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)] = TAG_FREE | TAG_CLEAN | i;
+    a->clean += POW_2(i) - POW_2(page_index);
+}
+
+// Retire le bloc b, que l'on sait présent, de la liste des blocs libres de
+// taille T(i)
+static void remove_bloc(struct arena *a, int i, union bloc *b)
+{
+    uint8_t *tag = &bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)];
+
+    b->prev_record->next_record = b->next_record;
+    b->next_record->prev_record = b->prev_record;
+    if (LIST_EMPTY(a, i)) {
+        a->free_mask &= ~((uint64_t) 1 << i);
+    }
+    a->nb_free[i]--;
+    if (*tag & TAG_CLEAN) {
+        a->clean -= POW_2(i) - POW_2(page_index);
+    } else if (PURGE_ON(i)) {
+        a->dirty -= POW_2(i);
+    }
+    *tag = 0;
+}
+
+// Retire et renvoie le premier bloc de la liste des blocs libres de taille
+// T(i), ou 0 si la liste est vide
+static union bloc *pop_bloc(struct arena *a, int i)
+{
+    union bloc *b = a->free_bloc[i].next_record;
+    if (b == &a->free_bloc[i]) {
+        return 0;
+    }
+    remove_bloc(a, i, b);
+    return b;
+}
+
+// Réserve len octets d'adresses, inaccessibles tant qu'elles ne sont pas
+// projetées par pool_grow. La zone commence à une adresse multiple de align
+// (une puissance de 2) : on réserve align octets de trop et on rend le
+// surplus de part et d'autre.
+static void *reserve_zone(uint64_t len, uint64_t align)
+{
+    uint8_t *p = mmap(0, len + align, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    uint8_t *base;
+
+    if (p == MAP_FAILED) {
+        return 0;
+    }
+    base = (uint8_t *) (((uintptr_t) p + align - 1) & ~(uintptr_t) (align - 1));
+    if (base > p) {
+        munmap(p, base - p);
+    }
+    if (base < p + align) {
+        munmap(base + len, p + align - base);
+    }
+    return base;
+}
+
+// Projette les len octets d'un chunk à l'adresse base, dans la réservation,
+// selon les options de mem_set_backing. MAP_HUGETLB échoue si le système n'a
+// pas de pages énormes réservées (vm.nr_hugepages) ou si len n'en est pas un
+// multiple : on se rabat alors sur des pages normales, en demandant au noyau
+// de les regrouper en pages énormes transparentes quand il le peut.
+static int map_chunk(uint8_t *base, uint64_t len)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+
+    // Préfaulter les pages n'a de sens que si on les réserve vraiment
+    if (pool_backing & MEM_POPULATE) {
+        flags |= MAP_POPULATE;
+    } else {
+        flags |= MAP_NORESERVE;
+    }
+#ifdef MAP_HUGETLB
+    if ((pool_backing & MEM_HUGEPAGE)
+        && mmap(base, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB,
+                -1, 0) != MAP_FAILED) {
+        pool_hugetlb = 1;
+        return 0;
+    }
+#endif
+    if (mmap(base, len, PROT_READ | PROT_WRITE, flags, -1, 0) == MAP_FAILED) {
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    if (pool_backing & MEM_HUGEPAGE) {
+        madvise(base, len, MADV_HUGEPAGE);
+    }
+#endif
+    return 0;
+}
+
+// Libère le memory_pool et les tableaux qui le décrivent
+static void pool_release()
+{
+    if (memory_pool) {
+        munmap(memory_pool, pool_reserved);
+    }
+    if (bloc_tag) {
+        munmap(bloc_tag, pool_reserved >> min_index);
+    }
+    if (arenas) {
+        munmap(arenas, max_arenas * sizeof(struct arena));
+    }
+    if (free_lists) {
+        munmap(free_lists, max_arenas * (arena_index + 1) * sizeof(union bloc));
+    }
+    memory_pool = 0;
+    bloc_tag = 0;
+    arenas = 0;
+    free_lists = 0;
+    pool_size = 0;
+}
+
+// Projette le chunk suivant de la réservation et en fait une nouvelle arène,
+// qui contient un seul bloc libre de taille maximale (faisant 2 puissance
+// arena_index octets). Renvoie 0 si tous les chunks sont déjà projetés.
+// En mode multi-thread, grow_lock doit être pris.
+static struct arena *pool_grow()
+{
+    unsigned int k = nb_arenas;
+    uint8_t *base = memory_pool + ((uint64_t) k << arena_index);
+    struct arena *a = &arenas[k];
+
+    if (k == max_arenas) {
+        return 0;
+    }
+    if (map_chunk(base, POW_2(arena_index)) != 0) {
+        return 0;
+    }
+
+    pthread_mutex_init(&a->lock, 0);
+    a->free_bloc = free_lists + k * (arena_index + 1);
+    for(int i = 0; i <= arena_index ; i++) {
+        a->free_bloc[i].next_record = &a->free_bloc[i];
+        a->free_bloc[i].prev_record = &a->free_bloc[i];
+    }
+    a->free_mask = 0;
+    a->remote = 0;
+    a->clean = 0;
+    a->dirty = 0;
+    memset(a->nb_free, 0, sizeof(a->nb_free));
+    a->splits = 0;
+    a->merges = 0;
+    memset(a->lf_head, 0, sizeof(a->lf_head));
+    memset(a->lf_count, 0, sizeof(a->lf_count));
+    // Les pages d'un chunk neuf ne sont pas encore en mémoire, sauf si on
+    // les a fait préfaulter
+    if (arena_index > page_index && !(pool_backing & MEM_POPULATE)) {
+        push_clean(a, arena_index, (union bloc*) base);
+    } else {
+        push_bloc(a, arena_index, (union bloc*) base);
+    }
+
+    // Les autres threads lisent nb_arenas et pool_size sans grow_lock
+    __atomic_store_n(&pool_size, pool_size + POW_2(arena_index), __ATOMIC_RELEASE);
+    __atomic_store_n(&nb_arenas, k + 1, __ATOMIC_RELEASE);
+    return a;
+}
+
+// Initialise un memory_pool de nb chunks de T(index) octets, avec des blocs
+// d'au moins T(min) octets, et réserve la place de max chunks.
+static int pool_init(int index, int min, unsigned int nb, unsigned int max)
+{
+    mem_generation++;
+    pool_release();
+    arena_index = index;
+    min_index = min;
+    max_arenas = max;
+    pool_reserved = (uint64_t) max << index;
+
+    pool_hugetlb = 0;
+    page_index = get_index(sysconf(_SC_PAGESIZE));
+
+    // Le memory_pool est aligné sur la taille d'une arène, qui est celle du
+    // plus grand bloc : l'offset d'un bloc et son adresse ont alors les mêmes
+    // bits de poids faible, et le compagnon d'un bloc s'obtient par un simple
+    // ou exclusif, aussi bien sur l'un que sur l'autre (voir buddy_free).
+    memory_pool = reserve_zone(pool_reserved, POW_2(arena_index));
+    bloc_tag = map_zone(pool_reserved >> min_index);
+    arenas = map_zone(max_arenas * sizeof(struct arena));
+    free_lists = map_zone(max_arenas * (arena_index + 1) * sizeof(union bloc));
+    if (memory_pool == 0 || bloc_tag == 0 || arenas == 0 || free_lists == 0) {
         /*perror("Cannot initialise memory\n");*/
+        pool_release();
         return -1;
     }
 
-    // À l'initialisation, seul un bloc de de taille maximal (faisant
-    // 2 puissance BUDDY_MAX_INDEX octets) est disponible.
-    /*for(int i = 0; i < BUDDY_MAX_INDEX - 1; i++) {
-        free_bloc[i].next_record = 0;
+    nb_arenas = 0;
+    for (unsigned int k = 0; k < nb; k++) {
+        if (pool_grow() == 0) {
+            pool_release();
+            return -1;
+        }
+    }
+    cur_arena = &arenas[0];
+    slab_reset();
+    stat_used = stat_peak = 0;
+    stat_failed = 0;
+    return 0;
+}
+
+// Initialise un memory_pool de pool_bytes octets (arrondi à la puissance de
+// 2 inférieure) avec des blocs d'au moins 2 puissance min_order octets.
+// min_order est relevé si besoin pour qu'un bloc libre puisse contenir son
+// chainage (MIN_SIZE_ALLOC). Les listes free_bloc et bloc_tag sont
+// dimensionnées en conséquence.
+static int buddy_init_ex(unsigned long pool_bytes, unsigned int min_order)
+{
+    int index, min = get_index(MIN_SIZE_ALLOC);
+
+    if (pool_bytes == 0) {
+        return -1;
+    }
+    index = (int) (sizeof(unsigned long) * 8) - 1 - __builtin_clzl(pool_bytes);
+    if ((int) min_order > min) {
+        min = min_order;
     }
-    free_bloc[BUDDY_MAX_INDEX - 1].next_record = (union bloc*) memory_pool;
-    free_bloc[BUDDY_MAX_INDEX - 1].next_record->next_record = NULL;*/
-    
-    for(int i = 0; i < BUDDY_MAX_INDEX ; i++) {
-        free_bloc[i].next_record = 0;
+    // free_mask n'a que 64 bits. Les piles sans verrou, qui numérotent les
+    // blocs sur 32 bits, ne servent qu'en mode multi-thread (voir
+    // mem_init_arenas et mem_init_elastic) : le nombre de blocs n'est pas
+    // limité ici.
+    if (index < min || index > 62) {
+        return -1;
+    }
+    mem_threaded = 0;
+    return pool_init(index, min, 1, 1);
+}
+
+static int buddy_mem_init(unsigned long pool_bytes)
+{
+    return buddy_init_ex(pool_bytes, 0);
+}
+
+// Comme mem_init, mais avec le buddy, un memory_pool de pool_bytes octets et
+// des blocs d'au moins 2 puissance min_order octets (voir buddy_init_ex)
+int mem_init_ex(unsigned long pool_bytes, unsigned int min_order)
+{
+    select_engine(MEM_BUDDY);
+    return buddy_init_ex(pool_bytes, min_order);
+}
+
+// Choisit comment les chunks des prochains mem_init* seront projetés :
+// MEM_HUGEPAGE pour des pages énormes (moins de défauts de TLB sur un grand
+// memory_pool), MEM_POPULATE pour que toutes les pages soient allouées dès
+// l'initialisation plutôt qu'au premier accès. Retourne -1 pour une option
+// inconnue.
+int mem_set_backing(unsigned int flags)
+{
+    if (flags & ~(MEM_HUGEPAGE | MEM_POPULATE)) {
+        return -1;
     }
-    free_bloc[BUDDY_MAX_INDEX].next_record = (union bloc*) memory_pool;
-    free_bloc[BUDDY_MAX_INDEX].next_record->next_record = NULL;
+    pool_backing = flags;
     return 0;
 }
 
+// Retourne 1 si le memory_pool courant utilise de vraies pages énormes
+// (MAP_HUGETLB), 0 s'il est en pages normales, éventuellement transparentes
+int mem_hugetlb()
+{
+    return pool_hugetlb;
+}
+
 /*// Retourne l'index de la première cellule de taille 2 puissance k >= size tel que
 // 2 puissance k-1 ≤ size < 2 puissance k dans le tableau memory.free_bloc
 int get_index(unsigned long size)
@@ -94,53 +497,24 @@ int get_index(unsigned long size)
 
 // Retourne l'index de la première cellule de taille 2 puissance k >= size tel que
 // 2 puissance k-1 < size <= 2 puissance k dans le tableau memory.free_bloc
+//
+// k est le nombre de bits significatifs de size - 1, obtenu en comptant les
+// zéros de tête (une seule instruction sur x86 et ARM) au lieu de boucler.
 int get_index(unsigned long size)
 {
-    int index;
-    for (index = 0; POW_2(index) < size; index++) {
-        ;}
-    return index/*-1*/;
-}
-
-// Retourne un bloc libre de taille T >= size, tel que
-// 2 puissance k ≤ T < 2 puissance (k+1)
-// Retourne 0 si il n'y a pas d'espace disponible.
-void *mem_alloc(unsigned long size)
-{
-    int index_celulle;
-
-    // On s'assure que la mémoire soit initialisée
-    if (memory_pool == 0) {
-        /*perror("Memory not initialized\n");*/
-        return 0;
-    }
-
-    // On s'assure que la taille ne soit pas nulle
-    if (size == 0) {
-       /* perror("Request of 0 byte allocation\n");*/
+    if (size <= 1) {
         return 0;
     }
-    if (size < MIN_SIZE_ALLOC) {
-        size = MIN_SIZE_ALLOC;
-    }
-
-    index_celulle = get_index(size);
-    // On s'assure que la taille demandée soit valide
-    if (index_celulle == BUDDY_MAX_INDEX) {
-        if (free_bloc[BUDDY_MAX_INDEX].next_record == 0)
-            return 0;
-        else {
-            free_bloc[BUDDY_MAX_INDEX].next_record = 0;
-            return memory_pool;
-        }
-    }
+    return (int) (sizeof(unsigned long) * 8) - __builtin_clzl(size - 1);
+}
 
+// Retourne un bloc libre de taille T(index_celulle) pris dans les listes
+// free_bloc de l'arène a, ou 0 si il n'y a pas d'espace disponible.
+static void *buddy_alloc(struct arena *a, int index_celulle)
+{
     // Cas 1, un bloc de taille T existe
-    if (free_bloc[index_celulle].next_record != 0) {
-        union bloc selected_bloc = free_bloc[index_celulle];
-        free_bloc[index_celulle].next_record = selected_bloc.next_record->next_record;
-
-        return selected_bloc.data;
+    if (!LIST_EMPTY(a, index_celulle)) {
+        return pop_bloc(a, index_celulle);
     }
 
     // Cas 2, il n'existe pas de bloc de taille T, on cherche le premier bloc
@@ -148,167 +522,1704 @@ void *mem_alloc(unsigned long size)
     // récursivement jusqu'à avoir un bloc de taille T.
     else {
         int i; // l'indice de la cellule de taille T * (2 puissance k)
-        for(i = index_celulle + 1; (i <= BUDDY_MAX_INDEX)
-                && (free_bloc[i].next_record == 0); i++) {
-        }
-        if (i > BUDDY_MAX_INDEX) /*Ici avant c'était >=*/{
+        uint64_t candidates = a->free_mask & (~(uint64_t) 0 << index_celulle);
+        if (candidates == 0) {
             // la taille demandée est plus grande que le plus grand bloc
             // disponible.
             /*perror("Not enough availlable space\n");*/
             return 0;
         }
+        i = __builtin_ctzll(candidates);
 
         // On a trouvé un bloc plus grand que necessaire, il faut maintenant
-        // le découper.
-        union bloc big_bloc = free_bloc[i];
-
-        // Tout d'abord on l'enlève de la chaine
-        free_bloc[i].next_record = big_bloc.next_record->next_record;
+        // le découper. Tout d'abord on l'enlève de la chaine.
+        // Les blocs sales sont en tête de liste, un bloc propre n'est pris
+        // que s'il n'y en a pas d'autre.
+        uint8_t *big_bloc = (uint8_t *) a->free_bloc[i].next_record;
+        int clean = bloc_tag[TAG_INDEX(big_bloc - memory_pool)] & TAG_CLEAN;
+        remove_bloc(a, i, (union bloc *) big_bloc);
+        a->splits += i - index_celulle;
 
         // Ensuite on le découpe en 2 récursivement. La taille des sous blocs
         // est de 2 puissance (i-1). On insère à chaque fois le deuxième sous
         // bloc dans la chaine, et on continue de découper le premier
-        // sous-bloc.
+        // sous-bloc. Les sous-blocs d'un bloc propre restent propres, tant
+        // qu'ils font plus d'une page.
         for(; i > index_celulle ; i--) {
-            free_bloc[i - 1].next_record = (union bloc*) (
-                big_bloc.data + POW_2(i - 1));
-            free_bloc[i - 1].next_record->next_record = 0;
+            union bloc *half = (union bloc*) (big_bloc + POW_2(i - 1));
+            if (clean && i - 1 > page_index) {
+                push_clean(a, i - 1, half);
+            } else {
+                push_bloc(a, i - 1, half);
+            }
         }
 
         // On à maintenant un bloc de taille T, qu'on peut retourner
-        return big_bloc.data;
+        return big_bloc;
     }
 }
 
-int mem_free(void *ptr, unsigned long size)
+// Rend aux listes de l'arène a la fin du bloc b de taille T(k), dont seuls
+// les used premiers octets (un multiple de T(min_index)) sont gardés. La fin
+// est rendue en blocs alignés, du plus petit au plus grand : le compagnon de
+// chacun est au moins en partie gardé, il n'y a donc rien à fusionner.
+static void trim_bloc(struct arena *a, uint8_t *b, uint64_t used, int k)
 {
-    /*Changement de variable pour éviter les casts à foison*/
-    union bloc *ptr2free = NULL;
-    ptr2free = ptr;
-    /*cpt compte le nombre de fois ou l'on change de case libre de même taille*/
-    int cpt = -2;
-    /*cpt_max sert à limiter le nombre de fois ou l'on change de cases libres de même taille afin d'éviter les boucles infinies*/
-    int cpt_max = ALLOC_MEM_SIZE / MIN_SIZE_ALLOC;
-    
-    if (size == 0) {
-        /*perror("Nothing to free\n");*/
-        return -1;
+    for (uint64_t pos = used; pos < POW_2(k); pos += pos & -pos) {
+        push_bloc(a, __builtin_ctzll(pos), (union bloc *) (b + pos));
+        a->splits++;
     }
-    /*TOUT l'espace mémoire a libérer doit faire partie de l'espace mémoire qui a été aloué par le malloc de mem_init()*/
-    else if((uint8_t *)ptr < memory_pool || (uint8_t*) ((unsigned long)ptr + size) > memory_pool + ALLOC_MEM_SIZE   || (uint8_t*) ptr > memory_pool + ALLOC_MEM_SIZE ) {
-        /*perror("Cannot free what hasn't been allocated\n");*/
+}
+
+// Rend au système les pages du bloc libre et sale b de taille T(i), sauf la
+// première qui porte son chainage, et le passe en queue de liste comme bloc
+// propre. MADV_DONTNEED libère les pages tout de suite (elles reviendront
+// remplies de zéros), ce qui fait baisser immédiatement la mémoire résidente
+// du processus.
+static void purge_bloc(struct arena *a, int i, union bloc *b)
+{
+    // Les pages énormes de MAP_HUGETLB ne peuvent pas être rendues en partie
+    if (pool_hugetlb) {
+        return;
+    }
+    madvise((uint8_t *) b + POW_2(page_index), POW_2(i) - POW_2(page_index),
+            MADV_DONTNEED);
+    remove_bloc(a, i, b);
+    push_clean(a, i, b);
+}
+
+// Purge tous les blocs sales de taille au moins T(purge_index) de l'arène a.
+// Les blocs sales étant en tête de liste, on s'arrête au premier bloc propre.
+static void purge_arena(struct arena *a)
+{
+    if (purge_index == 0 || pool_hugetlb) {
+        return;
+    }
+    for (int i = arena_index; i >= purge_index; i--) {
+        union bloc *b;
+        while ((b = a->free_bloc[i].next_record) != &a->free_bloc[i]
+               && !(bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)] & TAG_CLEAN)) {
+            purge_bloc(a, i, b);
+        }
+    }
+}
+
+// Rend aux listes free_bloc de l'arène a le bloc de taille T(i) situé à
+// offset octets du début de memory_pool, en le fusionnant avec ses
+// compagnons libres. Retourne -1 si le bloc est déjà libre.
+// Le bloc libéré a servi : il est sale, et le bloc fusionné l'est donc
+// aussi, même si ses compagnons étaient propres.
+static int buddy_free(struct arena *a, uint64_t offset, int i)
+{
+    // Un bloc déjà libre ne peut pas être libéré une deuxième fois.
+    if (bloc_tag[TAG_INDEX(offset)] & TAG_FREE) {
         return -1;
     }
-    else if (size == ALLOC_MEM_SIZE && ptr2free == (union bloc*) memory_pool) {
-        return mem_init();
-    }
-    if (size <= MIN_SIZE_ALLOC) {
-        size = MIN_SIZE_ALLOC;
-    }
-    //nb_blocs_before est le nombre de blocs mémoire de taille size entre
-    //le début du tableau free_bloc et l'adresse à libérer
-    unsigned long nb_blocs_before = ((unsigned long) ptr2free - (unsigned long) memory_pool) / size;
-    int i = get_index(size);
-    union bloc *browse = free_bloc[i].next_record;
-    union bloc *previous = NULL;
-    //Si nb_blocs_before est impaire, cela veut dire que ptr pointe vers la
-    //deuxième zone d'un couple de compagnons => on doit donc regarder si
-    //la première zone est libre.
-    if ( nb_blocs_before % 2 == 1) {
-        //On parcourt la liste des zones libres de taille size tant qu'on
-        //ne tombe pas sur NULL ou la première zone du couple de compagnons ou dans une chaine infinie
-        while (browse != 0  && browse != (union bloc*) ((unsigned long) ptr - size) 
-                            && browse->next_record != free_bloc[i].next_record
-                            && browse != browse->next_record
-                            && cpt < cpt_max) {
-            previous = browse;
-            browse = browse->next_record;
-            /*On s'assure que les zone libres restent dans l'espace mémoire qui a été aloué par le malloc de mem_init()*/
-            if((uint8_t *) browse < memory_pool || (uint8_t *) browse > memory_pool + ALLOC_MEM_SIZE)
-                {
-                    browse = 0;
-                }
-            /*Détecte rapidement les zones mémoires qui pointent sur elles-même (boucles infinies) => gain de temps d'exécution*/
-            if (browse != 0)
-                if (browse->next_record == previous)
-                    break;
-            cpt++;
-        }
-        /*Détecte les boucles infinies*/
-        if(cpt == cpt_max)
-        {
-            /*perror("Infinite loop\n");*/
-            return -1;
+
+    // Tant que le compagnon (buddy) du bloc est libre et de même taille, on
+    // le retire de sa liste et on fusionne les deux. L'état du compagnon est
+    // lu dans bloc_tag et le retrait de la liste doublement chainée ne demande
+    // pas de parcours, donc chaque étape est en temps constant.
+    while (i < arena_index) {
+        uint64_t buddy = offset ^ POW_2(i);
+        uint8_t tag = __atomic_load_n(&bloc_tag[TAG_INDEX(buddy)], __ATOMIC_RELAXED);
+        if ((tag & ~TAG_CLEAN) != (TAG_FREE | i)) {
+            break;
         }
-        /*Si le buddy n'est pas libre, on ne libère que la l'adresse ptr2free de taille size*/
-        if(browse == 0) {
-            ptr2free->next_record = free_bloc[i].next_record;
-            free_bloc[i].next_record = ptr2free;
+        remove_bloc(a, i, (union bloc *) (memory_pool + buddy));
+        offset &= ~POW_2(i);
+        i++;
+        a->merges++;
+    }
+    push_bloc(a, i, (union bloc *) (memory_pool + offset));
+    if (PURGE_ON(i) && a->dirty > purge_threshold) {
+        purge_arena(a);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Mode multi-thread
+//
+// Après mem_init_arenas(nb), le memory_pool est découpé en nb arènes et
+// chaque thread est rattaché à l'une d'elles, à tour de rôle. Les listes
+// free_bloc d'une arène sont protégées par son verrou.
+//
+// Pour ne pas prendre ce verrou à chaque appel, chaque thread garde, pour
+// chaque petite taille T(n) (n <= MAG_MAX_INDEX), un magasin : une pile bornée
+// d'au plus MAG_SIZE blocs de taille T(n) de son arène. Pour le buddy, les
+// blocs d'un magasin sont alloués (leur bloc_tag vaut 0) et ne sont donc pas
+// fusionnés.
+//
+// mem_alloc prend un bloc dans le magasin du thread sans verrou. Un magasin
+// vide est rempli de MAG_BATCH blocs et un magasin plein est vidé de
+// MAG_BATCH blocs, à chaque fois en une seule prise du verrou. Les magasins
+// d'un thread sont rendus au buddy quand il se termine, ou quand une
+// allocation échoue faute de place.
+//
+// Un bloc libéré par un thread qui n'est pas rattaché à son arène est empilé
+// sans verrou sur la file remote de cette arène, qui est vidée par la
+// prochaine allocation prenant le verrou de l'arène. Un producteur et un
+// consommateur rattachés à des arènes différentes ne se disputent donc
+// aucun verrou.
+//
+// Les plus petites tailles (n <= LF_MAX_INDEX), qui font l'essentiel du
+// trafic, ont en plus dans chaque arène une pile sans verrou de blocs libres
+// non fusionnés, placée devant free_bloc[n]. Un magasin plein y est vidé et
+// un magasin vide s'y remplit sans prendre le verrou de l'arène ; une
+// libération distante y va directement. Tant que la pile ne contient pas
+// plus de LF_LIMIT blocs, seul le passage par le buddy (fusion des
+// compagnons, découpe d'un grand bloc) demande le verrou. Quand une
+// allocation échoue, les piles sont vidées dans le buddy pour fusionner.
+//
+// mem_generation change à chaque mem_init et mem_destroy : un magasin d'une
+// génération précédente est simplement oublié.
+//////////////////////////////////////////////////////////////////////////////
+
+#define MAG_MAX_INDEX 12
+#define MAG_SIZE 32
+#define MAG_BATCH (MAG_SIZE / 2)
+
+struct magazine {
+    int   nb;
+    void *blocs[MAG_SIZE];
+};
+
+struct thread_cache {
+    unsigned long   generation;
+    struct arena   *arena;
+    struct magazine mag[MAG_MAX_INDEX + 1];
+    long            used;      // Pas encore reporté dans stat_used
+};
+
+static __thread struct thread_cache cache;
+static pthread_key_t  cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+// Empile sans verrou le bloc b de taille T(index) sur la file remote de
+// l'arène a. Plusieurs threads peuvent empiler en même temps, seul le
+// détenteur du verrou de l'arène dépile (en prenant toute la file d'un coup),
+// ce qui écarte le problème ABA.
+static void remote_push(struct arena *a, union bloc *b, int index)
+{
+    union bloc *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+    b->remote_index = index;
+    do {
+        b->next_remote = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, b, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// La tête d'une pile sans verrou tient dans un mot de 64 bits : le numéro de
+// la tranche de T(min_index) octets du bloc en tête, plus 1 (0 pour une
+// pile vide), et un compteur de versions incrémenté à chaque modification.
+// Un CAS qui verrait la même tête après qu'elle a été dépilée puis ré-empilée
+// par d'autres threads (problème ABA) échoue donc quand même.
+#define LF_SLOT(head) ((uint32_t) (head))
+#define LF_VERSION(head) ((uint32_t) ((head) >> 32))
+#define LF_HEAD(version, slot) (((uint64_t) (version) << 32) | (slot))
+
+static void lf_push(struct arena *a, int i, union bloc *b)
+{
+    uint32_t slot = TAG_INDEX((uint8_t *) b - memory_pool) + 1;
+    uint64_t head = __atomic_load_n(&a->lf_head[i], __ATOMIC_RELAXED);
+    uint64_t new_head;
+
+    do {
+        __atomic_store_n(&b->lf_next, LF_SLOT(head), __ATOMIC_RELAXED);
+        new_head = LF_HEAD(LF_VERSION(head) + 1, slot);
+    } while (!__atomic_compare_exchange_n(&a->lf_head[i], &head, new_head, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&a->lf_count[i], 1, __ATOMIC_RELAXED);
+}
+
+// Dépile un bloc, ou renvoie 0 si la pile est vide. Le bloc de tête peut
+// être dépilé et réutilisé par un autre thread pendant qu'on lit son champ
+// lf_next : la valeur lue est alors fausse, mais le CAS échoue.
+static union bloc *lf_pop(struct arena *a, int i)
+{
+    uint64_t head = __atomic_load_n(&a->lf_head[i], __ATOMIC_ACQUIRE);
+    uint64_t new_head;
+    union bloc *b;
+
+    do {
+        if (LF_SLOT(head) == 0) {
             return 0;
         }
-        /*Si le buddy est libre, on recommence en essayant de libérer le ptr2free et son buddy pour une taille à libérer de 2*size */
-        else {
-            if(previous != 0) {
-                previous->next_record = browse->next_record;
-            }
-            ptr2free = browse;
-            ptr2free->next_record = free_bloc[i + 1].next_record;
-            free_bloc[i + 1].next_record = ptr2free;
-            mem_free(ptr2free, size * 2);
+        b = (union bloc *) (memory_pool + ((uint64_t) (LF_SLOT(head) - 1) << min_index));
+        new_head = LF_HEAD(LF_VERSION(head) + 1,
+                           __atomic_load_n(&b->lf_next, __ATOMIC_RELAXED));
+    } while (!__atomic_compare_exchange_n(&a->lf_head[i], &head, new_head, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    __atomic_fetch_sub(&a->lf_count[i], 1, __ATOMIC_RELAXED);
+    return b;
+}
+
+// Vrai si la pile sans verrou de taille T(i) de l'arène a peut encore
+// recevoir nb blocs
+static int lf_room(struct arena *a, int i, int nb)
+{
+    return i <= LF_MAX_INDEX
+        && __atomic_load_n(&a->lf_count[i], __ATOMIC_RELAXED) + nb <= LF_LIMIT;
+}
+
+// Rend au buddy, pour qu'ils puissent fusionner, les blocs des piles sans
+// verrou de l'arène a. Son verrou doit être pris.
+static void lf_drain(struct arena *a)
+{
+    for (int i = 0; i <= LF_MAX_INDEX; i++) {
+        union bloc *b;
+        while ((b = lf_pop(a, i)) != 0) {
+            buddy_free(a, (uint8_t *) b - memory_pool, i);
         }
     }
-    //Si le nombre est paire, cela veut dire que ptr pointe vers la
-    //première zone d'un couple de compagnons => on doit donc regarder
-    //si la deuxième zone est libre.
-    else {
-        //On parcourt la liste des zones libres de taille size tant qu'on
-        //ne tombe pas sur NULL ou la première zone du couple de compagnons ou dans une chaine infinie
-        while (browse != 0  && browse != (union bloc*) ((unsigned long) ptr + size) 
-                            && browse != browse->next_record 
-                            && browse->next_record != free_bloc[i].next_record
-                            && cpt < cpt_max) {
-            previous = browse;
-            browse = browse->next_record;
-            /*On s'assure que les zone libres restent dans l'espace mémoire qui a été aloué par le malloc de mem_init()*/
-            if((uint8_t *) browse < memory_pool || (uint8_t *) browse > memory_pool + ALLOC_MEM_SIZE)
-            {
-                browse = 0;
-            }
-            /*Détecte rapidement les zones mémoires qui pointent sur elles-même (boucles infinies) => gain de temps d'exécution*/
-            if (browse != 0)
-                if (browse->next_record == previous)
-                    break;
-            cpt++;
-        }
-        /*Détecte les boucles infinies*/
-        if(cpt == cpt_max)
-        {
-            /*perror("Infinite loop\n");*/
-            return -1;
+}
+
+// Rend au buddy les blocs de la file remote de l'arène a. Son verrou doit
+// être pris.
+static void remote_drain(struct arena *a)
+{
+    union bloc *b;
+
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    b = __atomic_exchange_n(&a->remote, 0, __ATOMIC_ACQUIRE);
+    while (b != 0) {
+        union bloc *next = b->next_remote;
+        buddy_free(a, (uint8_t *) b - memory_pool, b->remote_index);
+        b = next;
+    }
+}
+
+// Rend au buddy tous les blocs des magasins de c. Le verrou de l'arène du
+// thread doit être pris.
+static void cache_flush(struct thread_cache *c)
+{
+    for (int i = 0; i <= MAG_MAX_INDEX; i++) {
+        struct magazine *m = &c->mag[i];
+        while (m->nb > 0) {
+            buddy_free(c->arena, (uint8_t *) m->blocs[--m->nb] - memory_pool, i);
         }
-        /*Si le buddy n'est pas libre, on ne libère que la l'adresse ptr2free de taille size*/
-        if(browse == 0) {
-            ptr2free->next_record = free_bloc[i].next_record;
-            free_bloc[i].next_record = ptr2free;
-            return 0;
+    }
+}
+
+// Appelée à la fin de chaque thread qui a utilisé ses magasins
+static void cache_destructor(void *arg)
+{
+    struct thread_cache *c = arg;
+    if (mem_threaded && c->generation == mem_generation) {
+        pthread_mutex_lock(&c->arena->lock);
+        cache_flush(c);
+        pthread_mutex_unlock(&c->arena->lock);
+        stat_publish(c->used);
+    }
+}
+
+static void cache_key_create(void)
+{
+    pthread_key_create(&cache_key, cache_destructor);
+}
+
+// Renvoie les magasins du thread courant. S'ils datent d'une génération
+// précédente, ils sont vidés et le thread est rattaché à une nouvelle arène.
+static struct thread_cache *get_cache()
+{
+    if (cache.generation != mem_generation) {
+        for (int i = 0; i <= MAG_MAX_INDEX; i++) {
+            cache.mag[i].nb = 0;
         }
-        /*Si le buddy est libre, on recommence en essayant de libérer le ptr2free et son buddy pour une taille à libérer de 2*size */
-        else {
-            if(previous != 0) {
-                previous->next_record = browse->next_record;
-            }
-            ptr2free->next_record = free_bloc[i + 1].next_record;
-            free_bloc[i + 1].next_record = ptr2free;
-            mem_free(ptr2free, size * 2);
+        cache.used = 0;
+        cache.arena = &arenas[__atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED)
+                              % __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE)];
+        cache.generation = mem_generation;
+        pthread_once(&cache_key_once, cache_key_create);
+        pthread_setspecific(cache_key, &cache);
+    }
+    return &cache;
+}
+
+// Ajoute delta octets aux octets alloués (voir stat_used)
+static void stat_use(long delta)
+{
+    struct thread_cache *c;
+
+    if (!mem_threaded) {
+        stat_used += delta;
+        if (stat_used > stat_peak) {
+            stat_peak = stat_used;
         }
+        return;
+    }
+    c = get_cache();
+    c->used += delta;
+    if (c->used >= STAT_FLUSH || c->used <= -STAT_FLUSH) {
+        stat_publish(c->used);
+        c->used = 0;
     }
-    return 0;
 }
 
+// buddy_alloc dans l'arène du thread qui, en cas d'échec, rend d'abord les
+// magasins du thread au buddy puis réessaie. Le verrou de l'arène doit être
+// pris.
+static void *buddy_alloc_or_flush(struct thread_cache *c, int index)
+{
+    void *b;
+
+    remote_drain(c->arena);
+    b = buddy_alloc(c->arena, index);
+    if (b == 0) {
+        cache_flush(c);
+        lf_drain(c->arena);
+        b = buddy_alloc(c->arena, index);
+    }
+    return b;
+}
 
-int mem_destroy()
+// Dernier recours quand l'arène du thread est pleine : on cherche un bloc
+// dans les autres arènes.
+static void *steal_alloc(struct arena *mine, int index)
 {
-    free(memory_pool);
-    memory_pool = 0;
+    unsigned int nb = __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE);
+
+    for (unsigned int k = 0; k < nb; k++) {
+        struct arena *a = &arenas[k];
+        void *b;
+
+        if (a == mine) {
+            continue;
+        }
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        b = buddy_alloc(a, index);
+        if (b == 0) {
+            lf_drain(a);
+            b = buddy_alloc(a, index);
+        }
+        pthread_mutex_unlock(&a->lock);
+        if (b != 0) {
+            return b;
+        }
+    }
     return 0;
 }
+
+// En mode élastique, quand aucune arène n'a de place : on projette un
+// nouveau chunk et le thread y est rattaché. Ses magasins ont déjà été rendus
+// à son ancienne arène par buddy_alloc_or_flush. Le chunk est visible des
+// autres threads dès pool_grow, et leur steal_alloc peut le vider avant
+// qu'on y alloue : on en projette alors un autre.
+static void *grow_alloc(struct thread_cache *c, int index)
+{
+    struct arena *a;
+    void *b = 0;
+
+    while (b == 0) {
+        pthread_mutex_lock(&grow_lock);
+        a = pool_grow();
+        pthread_mutex_unlock(&grow_lock);
+        if (a == 0) {
+            return 0;
+        }
+        c->arena = a;
+        pthread_mutex_lock(&a->lock);
+        b = buddy_alloc(a, index);
+        pthread_mutex_unlock(&a->lock);
+    }
+    return b;
+}
+
+static void *mt_alloc(int index)
+{
+    struct thread_cache *c = get_cache();
+    struct arena *a = c->arena;
+    struct magazine *m;
+    void *b;
+
+    if (index > MAG_MAX_INDEX) {
+        pthread_mutex_lock(&a->lock);
+        b = buddy_alloc_or_flush(c, index);
+        pthread_mutex_unlock(&a->lock);
+        if (b == 0) {
+            b = steal_alloc(a, index);
+        }
+        return b != 0 ? b : grow_alloc(c, index);
+    }
+
+    m = &c->mag[index];
+    if (m->nb == 0 && index <= LF_MAX_INDEX) {
+        while (m->nb < MAG_BATCH && (b = lf_pop(a, index)) != 0) {
+            m->blocs[m->nb++] = b;
+        }
+    }
+    if (m->nb == 0) {
+        pthread_mutex_lock(&a->lock);
+        b = buddy_alloc_or_flush(c, index);
+        while (b != 0 && m->nb < MAG_BATCH) {
+            m->blocs[m->nb++] = b;
+            b = buddy_alloc(a, index);
+        }
+        if (b != 0) {
+            buddy_free(a, (uint8_t *) b - memory_pool, index);
+        }
+        pthread_mutex_unlock(&a->lock);
+        if (m->nb == 0) {
+            b = steal_alloc(a, index);
+            return b != 0 ? b : grow_alloc(c, index);
+        }
+    }
+    return m->blocs[--m->nb];
+}
+
+static int mt_free(uint64_t offset, int index)
+{
+    struct thread_cache *c = get_cache();
+    struct arena *a = c->arena;
+    struct magazine *m;
+    int res = 0;
+
+    if (ARENA_OF(offset) != a) {
+        if (lf_room(ARENA_OF(offset), index, 1)) {
+            lf_push(ARENA_OF(offset), index, (union bloc *) (memory_pool + offset));
+        } else {
+            remote_push(ARENA_OF(offset), (union bloc *) (memory_pool + offset), index);
+        }
+        return 0;
+    }
+
+    if (index > MAG_MAX_INDEX) {
+        pthread_mutex_lock(&a->lock);
+        res = buddy_free(a, offset, index);
+        pthread_mutex_unlock(&a->lock);
+        return res;
+    }
+
+    m = &c->mag[index];
+    if (m->nb == MAG_SIZE && lf_room(a, index, MAG_BATCH)) {
+        for (int k = 0; k < MAG_BATCH; k++) {
+            lf_push(a, index, m->blocs[--m->nb]);
+        }
+    }
+    if (m->nb == MAG_SIZE) {
+        pthread_mutex_lock(&a->lock);
+        for (int k = 0; k < MAG_BATCH; k++) {
+            buddy_free(a, (uint8_t *) m->blocs[--m->nb] - memory_pool, index);
+        }
+        pthread_mutex_unlock(&a->lock);
+    }
+    m->blocs[m->nb++] = memory_pool + offset;
+    return 0;
+}
+
+// Comme mem_init, mais l'allocateur peut ensuite être utilisé par plusieurs
+// threads en même temps, et le memory_pool est formé de nb_arenas arènes
+// indépendantes. nb_arenas est arrondi à la puissance de 2 inférieure ;
+// s'il vaut 0, on prend le nombre de processeurs. Chaque arène fait
+// ALLOC_MEM_SIZE octets, comme le memory_pool du mode mono-thread : le
+// memory_pool en fait nb_arenas fois plus, et la plus grande allocation
+// possible reste ALLOC_MEM_SIZE octets quel que soit le nombre d'arènes (un
+// bloc ne peut pas dépasser son arène).
+//
+// mem_init_arenas elle-même, comme mem_init et mem_destroy, ne doit pas être
+// appelée pendant que d'autres threads utilisent l'allocateur.
+int mem_init_arenas(unsigned int nb)
+{
+    int res;
+
+    select_engine(MEM_BUDDY);
+    if (nb == 0) {
+        long nb_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nb = nb_cpu > 0 ? nb_cpu : 1;
+    }
+    if (nb > MAX_ARENAS) {
+        nb = MAX_ARENAS;
+    }
+    nb = 1U << (31 - __builtin_clz(nb));
+
+    res = pool_init(BUDDY_MAX_INDEX, get_index(MIN_SIZE_ALLOC), nb, nb);
+    mem_threaded = (res == 0);
+    return res;
+}
+
+// Mode multi-thread avec une seule arène
+int mem_init_mt()
+{
+    return mem_init_arenas(1);
+}
+
+// Comme mem_init, mais en mode élastique : le memory_pool démarre avec
+// nb_arenas chunks de chunk_bytes octets (arrondi à la puissance de 2
+// inférieure) et en projette de nouveaux à la demande, jusqu'à max_bytes
+// octets au total. Une allocation ne peut pas dépasser la taille d'un chunk.
+// Si nb_arenas vaut 0, l'allocateur est mono-thread et démarre avec un seul
+// chunk ; sinon il est multi-thread, comme avec mem_init_arenas.
+int mem_init_elastic(unsigned long chunk_bytes, unsigned long max_bytes,
+                     unsigned int nb)
+{
+    int index, min = get_index(MIN_SIZE_ALLOC), res;
+    unsigned long max;
+
+    select_engine(MEM_BUDDY);
+    if (chunk_bytes == 0) {
+        return -1;
+    }
+    index = (int) (sizeof(unsigned long) * 8) - 1 - __builtin_clzl(chunk_bytes);
+    if (index < min || index > 62) {
+        return -1;
+    }
+    max = max_bytes >> index;
+    if (max == 0 || max < nb) {
+        return -1;
+    }
+    // En mode multi-thread, les piles sans verrou numérotent les blocs sur
+    // 32 bits
+    if (nb != 0 && (index - min >= 32 || max > (UINT32_MAX >> (index - min)))) {
+        return -1;
+    }
+
+    mem_threaded = 0;
+    res = pool_init(index, min, nb != 0 ? nb : 1, max);
+    mem_threaded = (res == 0 && nb != 0);
+    return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Mode mono-thread, quand le chunk courant est plein : on cherche un chunk
+// qui a un bloc assez grand, sinon on en projette un nouveau.
+static void *st_alloc_slow(int index)
+{
+    struct arena *a;
+
+    for (unsigned int k = 0; k < nb_arenas; k++) {
+        if (arenas[k].free_mask & (~(uint64_t) 0 << index)) {
+            cur_arena = &arenas[k];
+            return buddy_alloc(cur_arena, index);
+        }
+    }
+    if ((a = pool_grow()) == 0) {
+        return 0;
+    }
+    cur_arena = a;
+    return buddy_alloc(a, index);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Slabs des petits objets
+//
+// Après mem_set_slab(max), en mode mono-thread, les demandes d'au plus max
+// octets (max <= SLAB_MAX_SIZE) ne passent plus par le découpage et la fusion
+// du buddy : elles sont arrondies à l'une des classes de slab_sizes, qui ne
+// sont pas que des puissances de 2 (24 ou 40 octets ne coûtent plus 32 ou 64),
+// et servies dans un slab de leur classe. Un slab est un bloc du buddy de
+// taille T(slab_index), aligné sur sa taille, qui commence par une struct
+// slab suivie de nb_obj objets de la classe. Le bit k de map vaut 1 si
+// l'objet k est libre : trouver un objet libre se fait en comptant les zéros
+// de queue d'un mot non nul.
+//
+// Les slabs d'une classe qui ont encore des objets libres sont dans la liste
+// circulaire slab_partial[classe]. Un slab qui redevient entièrement libre
+// est rendu aussitôt au buddy, qui peut le fusionner.
+//
+// L'octet bloc_tag du début d'un slab vaut TAG_SLAB, ni libre ni alloué :
+// mem_free et mem_free_ptr reconnaissent ainsi un objet de slab en lisant
+// l'octet du début du bloc de T(slab_index) qui le contient.
+
+#define SLAB_MAX_SIZE 512
+#define SLAB_MAX_OBJ 512
+#define SLAB_FIRST 96           // Décalage du premier objet dans le slab
+#define TAG_SLAB (slab_index)   // Sans TAG_FREE ni TAG_USED
+
+struct slab {
+    struct slab *next;
+    struct slab *prev;
+    uint16_t     cls;
+    uint16_t     nb_obj;
+    uint16_t     nb_free;
+    uint64_t     map[SLAB_MAX_OBJ / 64];
+};
+
+static const uint16_t slab_sizes[] = {
+    8, 16, 24, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384,
+    448, 512
+};
+#define NB_SLAB_CLASSES (sizeof(slab_sizes) / sizeof(slab_sizes[0]))
+
+static unsigned long slab_max = 0;      // 0 : pas de slab
+static int           slab_index = 12;
+static unsigned long nb_slabs = 0;
+static uint8_t       slab_class[SLAB_MAX_SIZE / 8 + 1]; // Par (size + 7) / 8
+static struct slab   slab_partial[NB_SLAB_CLASSES];     // Sentinelles
+
+// Vide les listes de slabs, pour un nouveau memory_pool
+static void slab_reset()
+{
+    for (unsigned int c = 0; c < NB_SLAB_CLASSES; c++) {
+        slab_partial[c].next = slab_partial[c].prev = &slab_partial[c];
+    }
+    nb_slabs = 0;
+    slab_index = min_index > 12 ? min_index : 12;
+}
+
+static void slab_link(struct slab *s)
+{
+    struct slab *head = &slab_partial[s->cls];
+    s->next = head->next;
+    s->prev = head;
+    head->next->prev = s;
+    head->next = s;
+}
+
+static void slab_unlink(struct slab *s)
+{
+    s->prev->next = s->next;
+    s->next->prev = s->prev;
+}
+
+// Prend un bloc au buddy et en fait un slab de la classe c
+static struct slab *slab_new(unsigned int c)
+{
+    struct slab *s = buddy_alloc(cur_arena, slab_index);
+    unsigned int nb;
+
+    if (s == 0 && (s = st_alloc_slow(slab_index)) == 0) {
+        return 0;
+    }
+    nb = (POW_2(slab_index) - SLAB_FIRST) / slab_sizes[c];
+    if (nb > SLAB_MAX_OBJ) {
+        nb = SLAB_MAX_OBJ;
+    }
+    s->cls = c;
+    s->nb_obj = nb;
+    s->nb_free = nb;
+    memset(s->map, 0, sizeof(s->map));
+    for (unsigned int k = 0; k < nb / 64; k++) {
+        s->map[k] = ~(uint64_t) 0;
+    }
+    if (nb % 64) {
+        s->map[nb / 64] = ((uint64_t) 1 << (nb % 64)) - 1;
+    }
+    bloc_tag[TAG_INDEX((uint8_t *) s - memory_pool)] = TAG_SLAB;
+    nb_slabs++;
+    slab_link(s);
+    return s;
+}
+
+static void *slab_alloc(unsigned long size)
+{
+    unsigned int c = slab_class[(size + 7) / 8];
+    struct slab *s = slab_partial[c].next;
+    unsigned int k = 0;
+
+    if (s == &slab_partial[c] && (s = slab_new(c)) == 0) {
+        return 0;
+    }
+    while (s->map[k] == 0) {
+        k++;
+    }
+    unsigned int bit = __builtin_ctzll(s->map[k]);
+    s->map[k] &= ~((uint64_t) 1 << bit);
+    if (--s->nb_free == 0) {
+        slab_unlink(s);
+    }
+    stat_use(slab_sizes[c]);
+    return (uint8_t *) s + SLAB_FIRST + (k * 64 + bit) * slab_sizes[s->cls];
+}
+
+// Retourne le slab qui contient ptr, ou 0 si ptr n'est pas dans un slab
+// (en particulier s'il n'est pas dans le memory_pool)
+static struct slab *slab_of(void *ptr)
+{
+    uint64_t offset;
+
+    if (nb_slabs == 0 || (uint8_t *) ptr < memory_pool
+        || (uint8_t *) ptr >= memory_pool + pool_size) {
+        return 0;
+    }
+    offset = ((uint8_t *) ptr - memory_pool) & ~(POW_2(slab_index) - 1);
+    if (bloc_tag[TAG_INDEX(offset)] != TAG_SLAB) {
+        return 0;
+    }
+    return (struct slab *) (memory_pool + offset);
+}
+
+// Rend l'objet ptr au slab s. size vaut 0 si l'appelant ne la connait pas
+static int slab_free(struct slab *s, void *ptr, unsigned long size)
+{
+    unsigned long obj = slab_sizes[s->cls];
+    uint64_t delta = (uint8_t *) ptr - (uint8_t *) s;
+    unsigned int k;
+
+    if (delta < SLAB_FIRST || (delta - SLAB_FIRST) % obj != 0
+        || (size != 0 && (size > obj || slab_class[(size + 7) / 8] != s->cls))) {
+        return -1;
+    }
+    k = (delta - SLAB_FIRST) / obj;
+    if (k >= s->nb_obj || (s->map[k / 64] >> (k % 64)) & 1) {
+        return -1;
+    }
+    s->map[k / 64] |= (uint64_t) 1 << (k % 64);
+    stat_use(-(long) obj);
+    if (s->nb_free++ == 0) {
+        slab_link(s);
+    }
+    if (s->nb_free == s->nb_obj) {
+        uint64_t offset = (uint8_t *) s - memory_pool;
+        slab_unlink(s);
+        nb_slabs--;
+        bloc_tag[TAG_INDEX(offset)] = 0;
+        buddy_free(ARENA_OF(offset), offset, slab_index);
+    }
+    return 0;
+}
+
+// Sert les demandes d'au plus max octets (au plus SLAB_MAX_SIZE) par les
+// slabs, en mode mono-thread. max nul désactive les slabs ; les objets déjà
+// alloués restent libérables.
+int mem_set_slab(unsigned long max)
+{
+    unsigned int c = 0;
+
+    if (max > SLAB_MAX_SIZE) {
+        return -1;
+    }
+    for (unsigned int i = 0; i <= SLAB_MAX_SIZE / 8; i++) {
+        while (slab_sizes[c] < i * 8) {
+            c++;
+        }
+        slab_class[i] = c;
+    }
+    slab_max = max;
+    return 0;
+}
+
+// Retourne un bloc libre de taille T >= size, tel que
+// 2 puissance k ≤ T < 2 puissance (k+1)
+// Retourne 0 si il n'y a pas d'espace disponible.
+static void *buddy_mem_alloc(unsigned long size)
+{
+    int index_celulle;
+
+    // On s'assure que la mémoire soit initialisée
+    if (memory_pool == 0) {
+        /*perror("Memory not initialized\n");*/
+        return 0;
+    }
+
+    // On s'assure que la taille ne soit pas nulle
+    if (size == 0) {
+       /* perror("Request of 0 byte allocation\n");*/
+        return 0;
+    }
+    if (size <= slab_max && !mem_threaded && slab_index < arena_index) {
+        void *o = slab_alloc(size);
+        stat_failed += (o == 0);
+        return o;
+    }
+    index_celulle = get_index(size);
+    if (index_celulle < min_index) {
+        index_celulle = min_index;
+    }
+    // On s'assure que la taille demandée soit valide
+    if (index_celulle > arena_index) {
+        __atomic_fetch_add(&stat_failed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    void *b;
+    if (mem_threaded) {
+        b = mt_alloc(index_celulle);
+    } else if ((b = buddy_alloc(cur_arena, index_celulle)) == 0) {
+        b = st_alloc_slow(index_celulle);
+    }
+    if (b == 0) {
+        __atomic_fetch_add(&stat_failed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_store_n(&bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)],
+                     TAG_USED | index_celulle, __ATOMIC_RELAXED);
+    stat_use(POW_2(index_celulle));
+    return b;
+}
+
+// Retourne un bloc de size octets dont l'adresse est un multiple de align
+// (une puissance de 2). Le memory_pool est aligné sur la taille d'une arène
+// et un bloc de T(i) octets l'est sur T(i) : si align <= T(i), un bloc
+// ordinaire convient. Sinon, on prend un bloc de T(log2(align)) octets, qui
+// est aligné, et on n'en garde que les T(i) premiers octets : le reste
+// retourne aussitôt aux listes. Le bloc obtenu est un bloc ordinaire de T(i)
+// octets, que mem_free et mem_free_ptr libèrent normalement.
+static void *buddy_mem_alloc_aligned(unsigned long size, unsigned long align)
+{
+    struct arena *a;
+    uint8_t *b;
+    int i, k;
+
+    if (memory_pool == 0 || size == 0 || align == 0 || (align & (align - 1))) {
+        return 0;
+    }
+    // Les objets des slabs sont alignés sur 8 octets
+    if (align <= 8) {
+        return buddy_mem_alloc(size);
+    }
+    i = get_index(size);
+    if (i < min_index) {
+        i = min_index;
+    }
+    k = get_index(align);
+    if (k < i) {
+        k = i;
+    }
+    if (k > arena_index) {
+        return 0;
+    }
+
+    if (mem_threaded) {
+        b = mt_alloc(k);
+    } else if ((b = buddy_alloc(cur_arena, k)) == 0) {
+        b = st_alloc_slow(k);
+    }
+    if (b == 0) {
+        __atomic_fetch_add(&stat_failed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (k > i) {
+        a = ARENA_OF((uint64_t) (b - memory_pool));
+        if (mem_threaded) {
+            pthread_mutex_lock(&a->lock);
+        }
+        trim_bloc(a, b, POW_2(i), k);
+        if (mem_threaded) {
+            pthread_mutex_unlock(&a->lock);
+        }
+    }
+    __atomic_store_n(&bloc_tag[TAG_INDEX(b - memory_pool)], TAG_USED | i,
+                     __ATOMIC_RELAXED);
+    stat_use(POW_2(i));
+    return b;
+}
+
+// Vérifie que le bloc de taille T(i) situé à offset octets du début du
+// memory_pool a bien été alloué par mem_alloc avec cette taille, et le marque
+// comme rendu. release_bloc le rend ensuite au buddy. Les accès à son bloc_tag sont atomiques car, en mode multi-thread, un autre
+// thread peut lire cet octet sous le verrou de l'arène pendant qu'il fusionne
+// le compagnon du bloc.
+static int take_bloc(uint64_t offset, int i)
+{
+    uint8_t *tag = &bloc_tag[TAG_INDEX(offset)];
+
+    if (__atomic_load_n(tag, __ATOMIC_RELAXED) != (TAG_USED | i)) {
+        return -1;
+    }
+    __atomic_store_n(tag, 0, __ATOMIC_RELAXED);
+    stat_use(-(long) POW_2(i));
+    return 0;
+}
+
+static int release_bloc(uint64_t offset, int i)
+{
+    if (take_bloc(offset, i) != 0) {
+        return -1;
+    }
+    if (mem_threaded) {
+        return mt_free(offset, i);
+    }
+    return buddy_free(ARENA_OF(offset), offset, i);
+}
+
+// Retourne l'index du bloc de size octets qui commence en ptr, et son
+// décalage dans offset, ou -1 si ptr et size ne peuvent pas être un bloc
+// du buddy
+static int bloc_index(void *ptr, unsigned long size, uint64_t *offset)
+{
+    int i;
+
+    if (memory_pool == 0 || size == 0) {
+        /*perror("Nothing to free\n");*/
+        return -1;
+    }
+    /*TOUT l'espace mémoire a libérer doit faire partie des chunks projetés par mem_init()*/
+    uint64_t mapped = __atomic_load_n(&pool_size, __ATOMIC_ACQUIRE);
+    if((uint8_t *)ptr < memory_pool || (uint8_t *) ptr > memory_pool + mapped || size > (uint64_t) (memory_pool + mapped - (uint8_t *) ptr) ) {
+        /*perror("Cannot free what hasn't been allocated\n");*/
+        return -1;
+    }
+    i = get_index(size);
+    if (i < min_index) {
+        i = min_index;
+    }
+    *offset = (uint8_t *) ptr - memory_pool;
+
+    // Un bloc de taille 2 puissance i est toujours aligné sur sa taille, et
+    // ne dépasse pas une arène
+    if ((*offset & (POW_2(i) - 1)) != 0 || i > arena_index) {
+        return -1;
+    }
+    return i;
+}
+
+static int buddy_mem_free(void *ptr, unsigned long size)
+{
+    struct slab *s;
+    uint64_t offset;
+    int i;
+
+    // size 0 ne vaut « inconnue » que pour mem_free_ptr
+    if (size == 0) {
+        return -1;
+    }
+    if (memory_pool != 0 && size <= SLAB_MAX_SIZE && (s = slab_of(ptr)) != 0) {
+        return slab_free(s, ptr, size);
+    }
+    if ((i = bloc_index(ptr, size, &offset)) < 0) {
+        return -1;
+    }
+    return release_bloc(offset, i);
+}
+
+// Comme buddy_mem_free, mais la taille du bloc est lue dans bloc_tag
+static int buddy_mem_free_ptr(void *ptr)
+{
+    struct slab *s;
+    uint64_t offset, mapped;
+    uint8_t tag;
+
+    if (memory_pool == 0) {
+        return -1;
+    }
+    mapped = __atomic_load_n(&pool_size, __ATOMIC_ACQUIRE);
+    if ((uint8_t *) ptr < memory_pool || (uint8_t *) ptr >= memory_pool + mapped) {
+        return -1;
+    }
+    if ((s = slab_of(ptr)) != 0) {
+        return slab_free(s, ptr, 0);
+    }
+    offset = (uint8_t *) ptr - memory_pool;
+    if ((offset & (POW_2(min_index) - 1)) != 0) {
+        return -1;
+    }
+    tag = __atomic_load_n(&bloc_tag[TAG_INDEX(offset)], __ATOMIC_RELAXED);
+    if ((tag & (TAG_FREE | TAG_USED)) != TAG_USED) {
+        return -1;
+    }
+    return release_bloc(offset, tag & TAG_ORDER);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Allocations et libérations groupées
+//
+// mem_alloc_batch(n, size, out) prend un seul bloc d'environ n * T(i) octets
+// et le découpe d'un coup en blocs de taille T(i), au lieu de faire n
+// descentes dans les listes. Les blocs sont contigus, et ce qui reste du
+// grand bloc est rendu aux listes en blocs alignés, sans fusion possible.
+//
+// mem_free_batch trie les blocs à libérer par adresse, par paquets de
+// BATCH_SIZE, et fusionne entre eux les compagnons qui se suivent avant de
+// toucher aux listes : n blocs contigus rendus ensemble ne coûtent qu'une
+// poignée de buddy_free. En mode multi-thread, le verrou de l'arène du thread
+// n'est pris qu'une fois par paquet.
+
+#define BATCH_SIZE 256
+
+struct batch_bloc {
+    uint64_t offset;
+    int      index;
+};
+
+// Retire de l'arène a jusqu'à n blocs de taille T(i), rangés dans out, et
+// retourne leur nombre. Le verrou de l'arène doit être pris en mode
+// multi-thread.
+static unsigned long buddy_alloc_run(struct arena *a, int i, unsigned long n,
+                                     void **out)
+{
+    unsigned long nb = 0;
+
+    while (nb < n) {
+        uint64_t candidates = a->free_mask & (~(uint64_t) 0 << i);
+        uint64_t pieces;
+        uint8_t *b;
+        int j, k;
+
+        if (candidates == 0) {
+            break;
+        }
+        // Le plus petit bloc qui donne les n - nb blocs restants, sinon le
+        // plus grand bloc libre
+        j = i + get_index(n - nb);
+        if (j > arena_index) {
+            j = arena_index;
+        }
+        k = (candidates & (~(uint64_t) 0 << j)) ? j : 63 - __builtin_clzll(candidates);
+        b = buddy_alloc(a, k);
+
+        pieces = POW_2(k - i) < n - nb ? POW_2(k - i) : n - nb;
+        a->splits += pieces - 1;
+        for (uint64_t p = 0; p < pieces; p++) {
+            out[nb++] = b + (p << i);
+            __atomic_store_n(&bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool) + (p << (i - min_index))],
+                             TAG_USED | i, __ATOMIC_RELAXED);
+        }
+        trim_bloc(a, b, pieces << i, k);
+    }
+    return nb;
+}
+
+static unsigned long buddy_mem_alloc_batch(unsigned long n, unsigned long size,
+                                           void **out)
+{
+    unsigned long nb = 0;
+    void *b;
+    int i;
+
+    if (memory_pool == 0 || size == 0) {
+        return 0;
+    }
+    if (size <= slab_max && !mem_threaded && slab_index < arena_index) {
+        while (nb < n && (out[nb] = slab_alloc(size)) != 0) {
+            nb++;
+        }
+        stat_failed += (nb < n);
+        return nb;
+    }
+    i = get_index(size);
+    if (i < min_index) {
+        i = min_index;
+    }
+    if (i > arena_index) {
+        return 0;
+    }
+
+    if (mem_threaded) {
+        struct thread_cache *c = get_cache();
+        pthread_mutex_lock(&c->arena->lock);
+        remote_drain(c->arena);
+        nb = buddy_alloc_run(c->arena, i, n, out);
+        pthread_mutex_unlock(&c->arena->lock);
+        // Le reste passe par les magasins, le vol et la croissance
+        while (nb < n && (b = mt_alloc(i)) != 0) {
+            __atomic_store_n(&bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)],
+                             TAG_USED | i, __ATOMIC_RELAXED);
+            out[nb++] = b;
+        }
+    } else {
+        while (nb < n) {
+            nb += buddy_alloc_run(cur_arena, i, n - nb, out + nb);
+            if (nb == n || (b = st_alloc_slow(i)) == 0) {
+                break;
+            }
+            bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)] = TAG_USED | i;
+            out[nb++] = b;
+        }
+    }
+    stat_use(nb << i);
+    if (nb < n) {
+        __atomic_fetch_add(&stat_failed, 1, __ATOMIC_RELAXED);
+    }
+    return nb;
+}
+
+static int batch_cmp(const void *x, const void *y)
+{
+    const struct batch_bloc *a = x, *b = y;
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+// Rend les nb blocs de tab, déjà vérifiés et marqués par take_bloc
+static void free_run(struct batch_bloc *tab, unsigned long nb)
+{
+    unsigned long top = 0, merges = 0;
+    struct arena *mine = 0;
+
+    // Les lots sont souvent libérés dans l'ordre où ils ont été alloués,
+    // donc déjà triés
+    for (unsigned long k = 1; k < nb; k++) {
+        if (tab[k].offset < tab[k - 1].offset) {
+            qsort(tab, nb, sizeof(*tab), batch_cmp);
+            break;
+        }
+    }
+
+    // Fusion des compagnons voisins dans le tableau trié, comme une pile :
+    // un bloc fusionne avec le sommet s'il en est le compagnon de droite
+    for (unsigned long k = 0; k < nb; k++) {
+        struct batch_bloc e = tab[k];
+        while (top > 0 && tab[top - 1].index == e.index && e.index < arena_index
+               && (tab[top - 1].offset ^ POW_2(e.index)) == e.offset
+               && tab[top - 1].offset < e.offset) {
+            e.offset = tab[--top].offset;
+            e.index++;
+            merges++;
+        }
+        tab[top++] = e;
+    }
+
+    // Les fusions sont comptées dans l'arène de l'appelant
+    if (!mem_threaded) {
+        cur_arena->merges += merges;
+        for (unsigned long k = 0; k < top; k++) {
+            buddy_free(ARENA_OF(tab[k].offset), tab[k].offset, tab[k].index);
+        }
+        return;
+    }
+    // Les blocs des autres arènes passent par leurs piles, sans verrou
+    mine = get_cache()->arena;
+    pthread_mutex_lock(&mine->lock);
+    mine->merges += merges;
+    for (unsigned long k = 0; k < top; k++) {
+        if (ARENA_OF(tab[k].offset) == mine) {
+            buddy_free(mine, tab[k].offset, tab[k].index);
+        }
+    }
+    pthread_mutex_unlock(&mine->lock);
+    for (unsigned long k = 0; k < top; k++) {
+        if (ARENA_OF(tab[k].offset) != mine) {
+            mt_free(tab[k].offset, tab[k].index);
+        }
+    }
+}
+
+static int buddy_mem_free_batch(void **ptrs, unsigned long *sizes,
+                                unsigned long n)
+{
+    struct batch_bloc tab[BATCH_SIZE];
+    unsigned long nb = 0;
+    int res = 0;
+
+    for (unsigned long k = 0; k < n; k++) {
+        struct slab *s;
+        uint64_t offset;
+        int i;
+
+        if (sizes[k] == 0) {
+            res = -1;
+            continue;
+        }
+        if (memory_pool != 0 && sizes[k] <= SLAB_MAX_SIZE
+            && (s = slab_of(ptrs[k])) != 0) {
+            res |= slab_free(s, ptrs[k], sizes[k]);
+            continue;
+        }
+        if ((i = bloc_index(ptrs[k], sizes[k], &offset)) < 0
+            || take_bloc(offset, i) != 0) {
+            res = -1;
+            continue;
+        }
+        tab[nb].offset = offset;
+        tab[nb].index = i;
+        if (++nb == BATCH_SIZE) {
+            free_run(tab, nb);
+            nb = 0;
+        }
+    }
+    free_run(tab, nb);
+    return res;
+}
+
+// Agrandit ou rétrécit sur place le bloc ptr de old_size octets pour qu'il
+// en fasse new_size, et le renvoie. Un bloc de T(i) octets grandit jusqu'à
+// T(j) octets s'il est au début du bloc de T(j) octets qui le contient, et
+// que ses compagnons de T(i), T(i+1), ..., T(j-1) octets sont tous libres :
+// on les retire de leur liste, comme pour une fusion. Un bloc rétrécit en
+// rendant aux listes sa fin, en blocs alignés (voir trim_bloc). Sinon, on
+// alloue un nouveau bloc, on y copie les données et on libère l'ancien.
+// Renvoie 0, sans toucher au bloc, si new_size octets ne peuvent pas être
+// alloués.
+static void *buddy_mem_realloc(void *ptr, unsigned long old_size,
+                               unsigned long new_size)
+{
+    struct arena *a;
+    struct slab *s;
+    uint64_t offset;
+    void *b;
+    int i, j, m;
+
+    if (ptr == 0) {
+        return buddy_mem_alloc(new_size);
+    }
+    if (new_size == 0) {
+        buddy_mem_free(ptr, old_size);
+        return 0;
+    }
+    if (old_size == 0) {
+        return 0;
+    }
+    if (memory_pool != 0 && old_size <= SLAB_MAX_SIZE && (s = slab_of(ptr)) != 0) {
+        if (new_size <= slab_sizes[s->cls]
+            && slab_class[(new_size + 7) / 8] == s->cls) {
+            return ptr;
+        }
+        goto copy;
+    }
+    if ((i = bloc_index(ptr, old_size, &offset)) < 0
+        || __atomic_load_n(&bloc_tag[TAG_INDEX(offset)], __ATOMIC_RELAXED) != (TAG_USED | i)) {
+        return 0;
+    }
+    j = get_index(new_size);
+    if (j < min_index) {
+        j = min_index;
+    }
+    if (j == i) {
+        return ptr;
+    }
+    if (j > arena_index) {
+        return 0;
+    }
+
+    a = ARENA_OF(offset);
+    if (mem_threaded) {
+        pthread_mutex_lock(&a->lock);
+    }
+    if (j < i) {
+        trim_bloc(a, ptr, POW_2(j), i);
+    } else {
+        // Tous les compagnons doivent être libres avant d'en retirer un
+        if ((offset & (POW_2(j) - 1)) != 0) {
+            goto unlock;
+        }
+        for (m = i; m < j; m++) {
+            uint8_t tag = __atomic_load_n(&bloc_tag[TAG_INDEX(offset + POW_2(m))],
+                                          __ATOMIC_RELAXED);
+            if ((tag & ~TAG_CLEAN) != (TAG_FREE | m)) {
+                goto unlock;
+            }
+        }
+        for (m = i; m < j; m++) {
+            remove_bloc(a, m, (union bloc *) (memory_pool + offset + POW_2(m)));
+        }
+        a->merges += j - i;
+    }
+    __atomic_store_n(&bloc_tag[TAG_INDEX(offset)], TAG_USED | j, __ATOMIC_RELAXED);
+    if (mem_threaded) {
+        pthread_mutex_unlock(&a->lock);
+    }
+    stat_use((long) POW_2(j) - (long) POW_2(i));
+    return ptr;
+
+unlock:
+    if (mem_threaded) {
+        pthread_mutex_unlock(&a->lock);
+    }
+copy:
+    if ((b = buddy_mem_alloc(new_size)) == 0) {
+        return 0;
+    }
+    memcpy(b, ptr, old_size < new_size ? old_size : new_size);
+    buddy_mem_free(ptr, old_size);
+    return b;
+}
+
+static int buddy_mem_destroy()
+{
+    pool_release();
+    mem_threaded = 0;
+    mem_generation++;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Rendu de la mémoire inutilisée au système
+
+// Recompte les octets des blocs sales de taille au moins T(purge_index) de
+// l'arène a, après un changement de purge_index
+static void count_dirty(struct arena *a)
+{
+    a->dirty = 0;
+    for (int i = purge_index; purge_index != 0 && i <= arena_index; i++) {
+        union bloc *b;
+        for (b = a->free_bloc[i].next_record; b != &a->free_bloc[i];
+             b = b->next_record) {
+            if (!(bloc_tag[TAG_INDEX((uint8_t *) b - memory_pool)] & TAG_CLEAN)) {
+                a->dirty += POW_2(i);
+            }
+        }
+    }
+}
+
+// Active le rendu au système des pages des blocs libres de taille au moins
+// 2 puissance min_order octets (relevé à deux pages), dès que les blocs sales
+// de cette taille dépassent threshold octets dans une arène. Avec threshold
+// nul, un tel bloc est purgé dès qu'il est libéré. min_order nul désactive
+// la purge.
+int mem_set_purge(unsigned int min_order, unsigned long threshold)
+{
+    unsigned int nb = memory_pool ? __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE) : 0;
+
+    for (unsigned int k = 0; k < nb; k++) {
+        pthread_mutex_lock(&arenas[k].lock);
+    }
+    page_index = get_index(sysconf(_SC_PAGESIZE));
+    if (min_order != 0 && (int) min_order <= page_index) {
+        min_order = page_index + 1;
+    }
+    purge_index = min_order;
+    purge_threshold = threshold;
+    for (unsigned int k = 0; k < nb; k++) {
+        count_dirty(&arenas[k]);
+        if (purge_index != 0 && arenas[k].dirty > purge_threshold) {
+            purge_arena(&arenas[k]);
+        }
+    }
+    for (unsigned int k = nb; k > 0; k--) {
+        pthread_mutex_unlock(&arenas[k - 1].lock);
+    }
+    return 0;
+}
+
+// Purge tout de suite tous les blocs libres éligibles, quel que soit le
+// seuil (pour une purge périodique décidée par l'application)
+void mem_purge()
+{
+    unsigned int nb = memory_pool ? __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE) : 0;
+
+    for (unsigned int k = 0; k < nb; k++) {
+        pthread_mutex_lock(&arenas[k].lock);
+        purge_arena(&arenas[k]);
+        pthread_mutex_unlock(&arenas[k].lock);
+    }
+}
+
+// Donne le nombre d'octets du memory_pool projeté qui peuvent être en
+// mémoire (resident), et de ceux dont on sait qu'ils n'y sont pas (purged),
+// car ils sont à l'intérieur de blocs libres propres
+int mem_purge_stats(unsigned long *resident, unsigned long *purged)
+{
+    uint64_t clean = 0;
+    unsigned int nb;
+
+    if (memory_pool == 0) {
+        return -1;
+    }
+    nb = __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE);
+    for (unsigned int k = 0; k < nb; k++) {
+        pthread_mutex_lock(&arenas[k].lock);
+        clean += arenas[k].clean;
+        pthread_mutex_unlock(&arenas[k].lock);
+    }
+    *resident = __atomic_load_n(&pool_size, __ATOMIC_ACQUIRE) - clean;
+    *purged = clean;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Statistiques
+//
+// Rien n'est parcouru : les blocs libres de chaque taille, les découpes et
+// les fusions sont comptés par arène au fil des opérations sur les listes,
+// et les octets alloués par stat_use. mem_stats ne fait qu'additionner les
+// compteurs des arènes.
+
+static int buddy_mem_stats(struct mem_stats *st)
+{
+    unsigned int nb;
+    long used;
+
+    memset(st, 0, sizeof(*st));
+    if (memory_pool == 0) {
+        return -1;
+    }
+    if (mem_threaded) {
+        struct thread_cache *c = get_cache();
+        stat_publish(c->used);
+        c->used = 0;
+    }
+    nb = __atomic_load_n(&nb_arenas, __ATOMIC_ACQUIRE);
+    for (unsigned int k = 0; k < nb; k++) {
+        struct arena *a = &arenas[k];
+        if (mem_threaded) {
+            pthread_mutex_lock(&a->lock);
+        }
+        for (int i = min_index; i <= arena_index; i++) {
+            st->free_blocks[i] += a->nb_free[i];
+            st->free_bytes += a->nb_free[i] << i;
+        }
+        if (a->free_mask != 0 && POW_2(63 - __builtin_clzll(a->free_mask)) > st->largest_free) {
+            st->largest_free = POW_2(63 - __builtin_clzll(a->free_mask));
+        }
+        st->splits += a->splits;
+        st->merges += a->merges;
+        if (mem_threaded) {
+            pthread_mutex_unlock(&a->lock);
+        }
+    }
+    st->mapped = __atomic_load_n(&pool_size, __ATOMIC_ACQUIRE);
+    used = __atomic_load_n(&stat_used, __ATOMIC_RELAXED);
+    st->in_use = used > 0 ? used : 0;
+    st->peak = __atomic_load_n(&stat_peak, __ATOMIC_RELAXED);
+    st->failed = __atomic_load_n(&stat_failed, __ATOMIC_RELAXED);
+    if (st->mapped > st->in_use + st->free_bytes) {
+        st->cached = st->mapped - st->in_use - st->free_bytes;
+    }
+    if (st->free_bytes != 0) {
+        st->fragmentation = 1.0 - (double) st->largest_free / st->free_bytes;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Choix de l'allocateur
+//
+// Les quatre allocateurs sont compilés dans la bibliothèque, et mem_init,
+// mem_alloc, mem_free et mem_destroy passent par la table de fonctions de
+// celui qui a été choisi à l'initialisation. Chaque allocateur garde son
+// propre chemin rapide : un appel ne coûte qu'un saut indirect de plus,
+// sans test sur la stratégie. La table est indexée par le numéro de SUJET de
+// chaque variante, qui reste l'allocateur par défaut.
+
+struct mem_engine {
+    const char *name;
+    int (*init)(unsigned long pool_bytes);
+    void *(*alloc)(unsigned long size);
+    int (*free)(void *ptr, unsigned long size);
+    int (*free_ptr)(void *ptr);
+    unsigned long (*alloc_batch)(unsigned long n, unsigned long size, void **out);
+    int (*free_batch)(void **ptrs, unsigned long *sizes, unsigned long n);
+    void *(*alloc_aligned)(unsigned long size, unsigned long align);
+    void *(*realloc)(void *ptr, unsigned long old_size, unsigned long new_size);
+    int (*stats)(struct mem_stats *st);
+    void *(*pool)();
+    int (*destroy)();
+};
+
+static const struct mem_engine *engine;
+
+static void *buddy_pool()
+{
+    return memory_pool;
+}
+
+// Les blocs alloués par CFF et BF ne portent pas leur taille
+static int no_free_ptr(void *ptr)
+{
+    return -1;
+}
+
+// Les autres allocateurs n'ont pas de chemin groupé : un appel par bloc
+static unsigned long loop_alloc_batch(unsigned long n, unsigned long size,
+                                      void **out)
+{
+    unsigned long nb = 0;
+    while (nb < n && (out[nb] = engine->alloc(size)) != 0) {
+        nb++;
+    }
+    return nb;
+}
+
+static int loop_free_batch(void **ptrs, unsigned long *sizes, unsigned long n)
+{
+    int res = 0;
+    for (unsigned long k = 0; k < n; k++) {
+        res |= engine->free(ptrs[k], sizes[k]);
+    }
+    return res;
+}
+
+// Les pools des autres allocateurs sont alignés sur une page et leurs blocs
+// sur au moins 16 octets, sans garantie au-delà
+static void *grain_alloc_aligned(unsigned long size, unsigned long align)
+{
+    if (align == 0 || (align & (align - 1)) || align > 16) {
+        return 0;
+    }
+    return engine->alloc(size);
+}
+
+static void *copy_realloc(void *ptr, unsigned long old_size,
+                          unsigned long new_size)
+{
+    void *b;
+
+    if (new_size == 0) {
+        engine->free(ptr, old_size);
+        return 0;
+    }
+    if ((b = engine->alloc(new_size)) != 0 && ptr != 0) {
+        memcpy(b, ptr, old_size < new_size ? old_size : new_size);
+        engine->free(ptr, old_size);
+    }
+    return b;
+}
+
+static const struct mem_engine engines[] = {
+    [MEM_CFF] = { "cff", cff_init, cff_alloc, cff_free, no_free_ptr,
+                  loop_alloc_batch, loop_free_batch, grain_alloc_aligned,
+                  copy_realloc, cff_stats, cff_pool, cff_destroy },
+    [MEM_BUDDY] = { "buddy", buddy_mem_init, buddy_mem_alloc, buddy_mem_free,
+                    buddy_mem_free_ptr, buddy_mem_alloc_batch,
+                    buddy_mem_free_batch, buddy_mem_alloc_aligned,
+                    buddy_mem_realloc, buddy_mem_stats, buddy_pool,
+                    buddy_mem_destroy },
+    [MEM_WBUDDY] = { "wbuddy", wbuddy_init, wbuddy_alloc, wbuddy_free,
+                     wbuddy_free_ptr, loop_alloc_batch, loop_free_batch,
+                     grain_alloc_aligned, copy_realloc, wbuddy_stats,
+                     wbuddy_pool, wbuddy_destroy },
+    [MEM_BF] = { "bf", bf_init, bf_alloc, bf_free, no_free_ptr,
+                 loop_alloc_batch, loop_free_batch, grain_alloc_aligned,
+                 copy_realloc, bf_stats, bf_pool, bf_destroy },
+};
+#define NB_ENGINES (int) (sizeof(engines) / sizeof(engines[0]))
+
+static const struct mem_engine *engine = &engines[SUJET];
+
+#ifdef MEM_TRACE
+// Position de ptr dans le pool, pour la trace
+static uint64_t trace_offset(void *ptr)
+{
+    if (ptr == 0) {
+        return MEM_TRACE_NULL;
+    }
+    return (uint8_t *) ptr - (uint8_t *) engine->pool();
+}
+#endif
+
+static void select_engine(int strategy)
+{
+    if (engine != &engines[strategy]) {
+        engine->destroy();
+        engine = &engines[strategy];
+    }
+}
+
+// Comme mem_init, avec l'allocateur strategy (MEM_CFF, MEM_BUDDY, MEM_WBUDDY
+// ou MEM_BF)
+int mem_init_strategy(int strategy)
+{
+    if (strategy < 0 || strategy >= NB_ENGINES) {
+        return -1;
+    }
+    select_engine(strategy);
+    MEM_TRACE_EVENT(MEM_TRACE_INIT, ALLOC_MEM_SIZE, strategy);
+    return engine->init(ALLOC_MEM_SIZE);
+}
+
+// Allocateur de mem_init, -1 tant que l'environnement n'a pas été lu, et
+// NB_ENGINES si ALLOCPHY_STRATEGY ne nomme aucun allocateur
+static int env_strategy = -1;
+
+// Lit les variables d'environnement, au premier mem_init
+static void read_env()
+{
+    const char *name = getenv("ALLOCPHY_STRATEGY");
+
+    env_strategy = SUJET;
+    if (name != 0 && *name != '\0') {
+        for (env_strategy = 0; env_strategy < NB_ENGINES; env_strategy++) {
+            if (strcmp(name, engines[env_strategy].name) == 0) {
+                break;
+            }
+        }
+    }
+#ifdef MEM_TRACE
+    const char *path = getenv("ALLOCPHY_TRACE");
+    if (path != 0 && *path != '\0' && !mem_trace_on) {
+        mem_trace_start(path);
+    }
+#endif
+}
+
+// L'allocateur est celui de la variante, sauf si la variable d'environnement
+// ALLOCPHY_STRATEGY en nomme un autre (cff, buddy, wbuddy ou bf). Si la trace
+// est compilée, ALLOCPHY_TRACE donne le fichier où tracer les appels. Ces
+// variables ne sont lues qu'une fois, au premier appel.
+int mem_init()
+{
+    if (env_strategy < 0) {
+        read_env();
+    }
+    return mem_init_strategy(env_strategy);
+}
+
+// Retourne l'allocateur courant
+int mem_strategy()
+{
+    return (int) (engine - engines);
+}
+
+void *mem_alloc(unsigned long size)
+{
+    void *b = engine->alloc(size);
+    MEM_TRACE_EVENT(MEM_TRACE_ALLOC, size, trace_offset(b));
+    return b;
+}
+
+int mem_free(void *ptr, unsigned long size)
+{
+    MEM_TRACE_EVENT(MEM_TRACE_FREE, size, trace_offset(ptr));
+    return engine->free(ptr, size);
+}
+
+// Comme mem_free, sans la taille : seuls le buddy et le buddy pondéré, qui
+// notent l'index de chaque bloc alloué, le permettent
+int mem_free_ptr(void *ptr)
+{
+    MEM_TRACE_EVENT(MEM_TRACE_FREE, 0, trace_offset(ptr));
+    return engine->free_ptr(ptr);
+}
+
+// Alloue jusqu'à n blocs de size octets, rangés dans out, et retourne le
+// nombre de blocs alloués
+unsigned long mem_alloc_batch(unsigned long n, unsigned long size, void *out[])
+{
+    unsigned long nb = engine->alloc_batch(n, size, out);
+#ifdef MEM_TRACE
+    for (unsigned long k = 0; k < nb; k++) {
+        MEM_TRACE_EVENT(MEM_TRACE_ALLOC, size, trace_offset(out[k]));
+    }
+#endif
+    return nb;
+}
+
+// Libère les n blocs ptrs[k] de sizes[k] octets. Retourne -1 si l'un d'eux
+// n'a pas pu être libéré, les autres l'étant quand même.
+int mem_free_batch(void *ptrs[], unsigned long sizes[], unsigned long n)
+{
+#ifdef MEM_TRACE
+    for (unsigned long k = 0; k < n; k++) {
+        MEM_TRACE_EVENT(MEM_TRACE_FREE, sizes[k], trace_offset(ptrs[k]));
+    }
+#endif
+    return engine->free_batch(ptrs, sizes, n);
+}
+
+// Comme mem_alloc, mais l'adresse du bloc est un multiple de align, une
+// puissance de 2. Le bloc se libère avec mem_free(ptr, size).
+void *mem_alloc_aligned(unsigned long size, unsigned long align)
+{
+    void *b = engine->alloc_aligned(size, align);
+    MEM_TRACE_EVENT(MEM_TRACE_ALLOC, size, trace_offset(b));
+    return b;
+}
+
+// Change la taille du bloc ptr de old_size octets en new_size, en
+// conservant son contenu, et renvoie sa nouvelle adresse. Le buddy le fait
+// sur place quand il le peut. Renvoie 0 si new_size octets ne peuvent pas
+// être alloués, le bloc ptr restant alors alloué. Comme realloc, ptr nul
+// alloue et new_size nul libère.
+//
+// Dans la trace, un mem_realloc réussi apparait comme la libération de
+// l'ancien bloc suivie de l'allocation du nouveau.
+void *mem_realloc(void *ptr, unsigned long old_size, unsigned long new_size)
+{
+    void *b = engine->realloc(ptr, old_size, new_size);
+#ifdef MEM_TRACE
+    if (ptr != 0 && (b != 0 || new_size == 0)) {
+        MEM_TRACE_EVENT(MEM_TRACE_FREE, old_size, trace_offset(ptr));
+    }
+    if (new_size != 0) {
+        MEM_TRACE_EVENT(MEM_TRACE_ALLOC, new_size, trace_offset(b));
+    }
+#endif
+    return b;
+}
+
+// Remplit st avec les compteurs de l'allocateur. Retourne -1 (tout est
+// alors à 0) s'il n'est pas initialisé.
+int mem_stats(struct mem_stats *st)
+{
+    return engine->stats(st);
+}
+
+int mem_destroy()
+{
+    MEM_TRACE_EVENT(MEM_TRACE_DESTROY, 0, 0);
+    return engine->destroy();
+}
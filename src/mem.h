@@ -16,20 +16,27 @@
 // Circular First Fit default value
 #define CFF
 #define CFF_MAX_INDEX 20
-#define ALLOC_MEM_SIZE ((unsigned int) 1<< CFF_MAX_INDEX)
+#define ALLOC_MEM_SIZE ((unsigned long) 1<< CFF_MAX_INDEX)
 
 #elif SUJET == 1
 // Buddy default value
 #define BUDDY
 #define BUDDY_MAX_INDEX 20
-#define ALLOC_MEM_SIZE ((unsigned int) 1<< BUDDY_MAX_INDEX)
+#define ALLOC_MEM_SIZE ((unsigned long) 1<< BUDDY_MAX_INDEX)
 
 #elif SUJET == 2
 
 // Weigthed buddy default values
 #define WBUDDY
 #define WBUDDY_MAX_INDEX 40
-#define ALLOC_MEM_SIZE ((unsigned int) 1<<(WBUDDY_MAX_INDEX/2))
+#define ALLOC_MEM_SIZE ((unsigned long) 1<<(WBUDDY_MAX_INDEX/2))
+
+#elif SUJET == 3
+
+// Best fit default value
+#define BF
+#define BF_MAX_INDEX 20
+#define ALLOC_MEM_SIZE ((unsigned long) 1<< BF_MAX_INDEX)
 
 #else
 #error "*** ERREUR GRAVE *** Le numéro de sujet est incohérent !! "
@@ -45,6 +52,54 @@ extern "C" {
     int mem_free(void *ptr, unsigned long size);
     int mem_destroy();
 
+    // Extensions
+#define MEM_CFF 0
+#define MEM_BUDDY 1
+#define MEM_WBUDDY 2
+#define MEM_BF 3
+    int mem_init_strategy(int strategy);
+    int mem_strategy();
+    int mem_init_ex(unsigned long pool_bytes, unsigned int min_order);
+    int mem_init_mt();
+    int mem_init_arenas(unsigned int nb_arenas);
+    int mem_init_elastic(unsigned long chunk_bytes, unsigned long max_bytes,
+                         unsigned int nb_arenas);
+
+#define MEM_HUGEPAGE 1
+#define MEM_POPULATE 2
+    int mem_free_ptr(void *ptr);
+    int mem_set_backing(unsigned int flags);
+    int mem_hugetlb();
+    int mem_set_purge(unsigned int min_order, unsigned long threshold);
+    void mem_purge();
+    int mem_purge_stats(unsigned long *resident, unsigned long *purged);
+    int mem_set_slab(unsigned long max_size);
+    unsigned long mem_alloc_batch(unsigned long n, unsigned long size, void *out[]);
+    int mem_free_batch(void *ptrs[], unsigned long sizes[], unsigned long n);
+    void *mem_alloc_aligned(unsigned long size, unsigned long alignment);
+    void *mem_realloc(void *ptr, unsigned long old_size, unsigned long new_size);
+
+    // Voir mem_stats. free_blocks[k] compte les blocs libres de 2 puissance
+    // k octets ; en mode multi-thread, in_use et peak peuvent être en retard
+    // de quelques dizaines de Kio par thread. CFF, Best Fit et le buddy
+    // pondéré ne remplissent ni free_blocks, ni cached, ni splits et merges.
+    struct mem_stats {
+        unsigned long in_use;        // Octets des blocs alloués
+        unsigned long peak;          // Maximum de in_use depuis mem_init
+        unsigned long mapped;        // Octets des chunks projetés
+        unsigned long free_bytes;    // Octets des blocs des listes libres
+        unsigned long cached;        // Ni l'un ni l'autre : magasins, slabs...
+        unsigned long largest_free;  // Plus grand bloc libre
+        unsigned long free_blocks[64];
+        unsigned long splits;        // Découpes d'un bloc en deux
+        unsigned long merges;        // Fusions de deux compagnons
+        unsigned long failed;        // Allocations qui ont échoué
+        double fragmentation;        // 1 - largest_free / free_bytes
+    };
+    int mem_stats(struct mem_stats *st);
+    int mem_trace_start(const char *path);
+    long mem_trace_stop();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,302 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdint.h>
+#include "mem_bf.h"
+#include "mem_grain.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Best Fit
+//
+// Comme pour CFF (voir mem_cff.c), le pool est découpé en grains, ici de
+// BF_GRAIN octets, avec des étiquettes de frontière (voir mem_grain.h) : un
+// bloc alloué ne porte aucune entête, et les voisins libres d'un bloc libéré
+// sont trouvés et fusionnés en temps constant.
+//
+// Les blocs libres sont rangés par taille, pour trouver le plus petit bloc
+// assez grand sans parcourir tous les blocs libres :
+// - un bloc de taille au plus BF_BIN_MAX est dans la liste bins[taille /
+//   BF_GRAIN], circulaire et doublement chainée. Chaque liste ne contient
+//   qu'une seule taille, et le bit correspondant de bin_mask dit si elle est
+//   vide : la plus petite liste non vide assez grande se trouve en comptant
+//   les zéros de queue ;
+// - un bloc plus grand est dans un arbre binaire de recherche, trié par
+//   taille puis par adresse, et équilibré en treap : chaque bloc a une
+//   priorité pseudo-aléatoire tirée de son adresse, et un père a toujours une
+//   priorité plus grande que ses fils. La profondeur est alors en moyenne
+//   logarithmique, comme la recherche du meilleur bloc, l'ajout et le
+//   retrait.
+// Un bloc libre d'un seul grain est trop petit pour être chainé : il n'est
+// rangé nulle part et n'est réutilisé qu'une fois fusionné avec un voisin.
+
+#define BF_GRAIN 16
+#define BF_BIN_MAX (63 * BF_GRAIN)
+
+struct bf_bloc {
+    uint64_t        size;  // En octets
+    struct bf_bloc *left;  // next_record pour les listes bins
+    struct bf_bloc *right; // prev_record pour les listes bins
+    // ... puis le pied, un uint64_t égal à size, dans les 8 derniers octets
+};
+
+static struct grain_pool zone;
+static struct bf_bloc    bins[64];      // Sentinelles
+static uint64_t          bin_mask = 0;
+static struct bf_bloc   *tree = 0;
+
+//////////////////////////////////////////////////////////////////////////////
+// Treap des grands blocs
+
+static uint32_t priority(struct bf_bloc *b)
+{
+    return (uint32_t) (((uintptr_t) b / BF_GRAIN) * 2654435761u);
+}
+
+static int less(struct bf_bloc *a, struct bf_bloc *b)
+{
+    return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static struct bf_bloc *rotate_right(struct bf_bloc *t)
+{
+    struct bf_bloc *l = t->left;
+    t->left = l->right;
+    l->right = t;
+    return l;
+}
+
+static struct bf_bloc *rotate_left(struct bf_bloc *t)
+{
+    struct bf_bloc *r = t->right;
+    t->right = r->left;
+    r->left = t;
+    return r;
+}
+
+static struct bf_bloc *tree_insert(struct bf_bloc *t, struct bf_bloc *b)
+{
+    if (t == 0) {
+        b->left = b->right = 0;
+        return b;
+    }
+    if (less(b, t)) {
+        t->left = tree_insert(t->left, b);
+        if (priority(t->left) > priority(t)) {
+            t = rotate_right(t);
+        }
+    } else {
+        t->right = tree_insert(t->right, b);
+        if (priority(t->right) > priority(t)) {
+            t = rotate_left(t);
+        }
+    }
+    return t;
+}
+
+// Réunit deux sous-arbres, toutes les clés de l à gauche de celles de r
+static struct bf_bloc *tree_join(struct bf_bloc *l, struct bf_bloc *r)
+{
+    if (l == 0) {
+        return r;
+    }
+    if (r == 0) {
+        return l;
+    }
+    if (priority(l) > priority(r)) {
+        l->right = tree_join(l->right, r);
+        return l;
+    }
+    r->left = tree_join(l, r->left);
+    return r;
+}
+
+static struct bf_bloc *tree_remove(struct bf_bloc *t, struct bf_bloc *b)
+{
+    if (t == b) {
+        return tree_join(t->left, t->right);
+    }
+    if (less(b, t)) {
+        t->left = tree_remove(t->left, b);
+    } else {
+        t->right = tree_remove(t->right, b);
+    }
+    return t;
+}
+
+// Le plus petit bloc de taille >= n, ou 0
+static struct bf_bloc *tree_best(uint64_t n)
+{
+    struct bf_bloc *t = tree, *best = 0;
+
+    while (t) {
+        if (t->size >= n) {
+            best = t;
+            t = t->left;
+        } else {
+            t = t->right;
+        }
+    }
+    return best;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Range le bloc libre b de taille size : étiquettes, puis liste ou arbre
+static void add_free(struct bf_bloc *b, uint64_t size)
+{
+    grain_set_free(&zone, b, size);
+    if (size <= BF_GRAIN) {
+        return;
+    }
+    if (size <= BF_BIN_MAX) {
+        struct bf_bloc *s = &bins[size / BF_GRAIN];
+        b->left = s->left;
+        b->right = s;
+        s->left->right = b;
+        s->left = b;
+        bin_mask |= (uint64_t) 1 << (size / BF_GRAIN);
+    } else {
+        tree = tree_insert(tree, b);
+    }
+}
+
+// Retire le bloc libre b de sa liste ou de l'arbre, et efface ses étiquettes
+static void remove_free(struct bf_bloc *b)
+{
+    grain_clear_free(&zone, b);
+    if (b->size <= BF_GRAIN) {
+        return;
+    }
+    if (b->size <= BF_BIN_MAX) {
+        struct bf_bloc *s = &bins[b->size / BF_GRAIN];
+        b->right->left = b->left;
+        b->left->right = b->right;
+        if (s->left == s) {
+            bin_mask &= ~((uint64_t) 1 << (b->size / BF_GRAIN));
+        }
+    } else {
+        tree = tree_remove(tree, b);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Début du pool, pour la trace (voir mem_trace.c)
+void *bf_pool()
+{
+    return zone.base;
+}
+
+int bf_destroy()
+{
+    grain_destroy(&zone);
+    return 0;
+}
+
+// Initialise un pool de pool_bytes octets (arrondi au grain inférieur),
+// formé d'un seul bloc libre
+int bf_init(unsigned long pool_bytes)
+{
+    if (grain_init(&zone, pool_bytes, BF_GRAIN) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 64; i++) {
+        bins[i].left = bins[i].right = &bins[i];
+    }
+    bin_mask = 0;
+    tree = 0;
+    add_free((struct bf_bloc *) zone.base, zone.size);
+    return 0;
+}
+
+void *bf_alloc(unsigned long size)
+{
+    struct bf_bloc *b = 0;
+    uint64_t n, candidates;
+
+    if (zone.base == 0 || size == 0) {
+        return 0;
+    }
+    if (size > zone.size) {
+        zone.failed++;
+        return 0;
+    }
+    n = (size + BF_GRAIN - 1) & ~(uint64_t) (BF_GRAIN - 1);
+
+    // Un bloc d'un seul grain n'est rangé nulle part, on cherche au moins 2
+    candidates = n < BF_GRAIN * 2 ? 2 : n / BF_GRAIN;
+    candidates = n <= BF_BIN_MAX ? bin_mask & (~(uint64_t) 0 << candidates) : 0;
+    if (candidates != 0) {
+        b = bins[__builtin_ctzll(candidates)].left;
+    } else {
+        b = tree_best(n);
+    }
+    if (b == 0) {
+        zone.failed++;
+        return 0;
+    }
+
+    uint64_t total = b->size;
+    remove_free(b);
+    if (total > n) {
+        add_free((struct bf_bloc *) ((uint8_t *) b + n), total - n);
+    }
+    BIT_SET(zone.used_map, grain_of(&zone, b));
+    grain_count_alloc(&zone, n);
+    return b;
+}
+
+int bf_free(void *ptr, unsigned long size)
+{
+    struct bf_bloc *b = ptr, *left, *right;
+    uint64_t n, g;
+
+    n = (size + BF_GRAIN - 1) & ~(uint64_t) (BF_GRAIN - 1);
+    // Le bloc n'a pas d'entête : on vérifie que size est bien sa taille, pour
+    // ne pas rendre libre un voisin encore alloué
+    if (grain_check_used(&zone, ptr, n) != 0) {
+        return -1;
+    }
+    g = grain_of(&zone, ptr);
+    BIT_CLR(zone.used_map, g);
+    zone.in_use -= n;
+
+    // Fusion avec le voisin de gauche, puis celui de droite
+    if ((left = grain_left_free(&zone, g)) != 0) {
+        n += left->size;
+        remove_free(left);
+        b = left;
+        g = grain_of(&zone, b);
+    }
+    if ((right = grain_right_free(&zone, g, n)) != 0) {
+        n += right->size;
+        remove_free(right);
+    }
+    add_free(b, n);
+    return 0;
+}
+
+// Le plus grand bloc libre est tout à droite de l'arbre, sinon dans la
+// dernière liste non vide. Les blocs d'un seul grain ne sont rangés nulle
+// part : s'il reste des octets libres, c'est qu'il y en a.
+int bf_stats(struct mem_stats *st)
+{
+    uint64_t largest = 0;
+
+    if (zone.base != 0) {
+        if (tree != 0) {
+            struct bf_bloc *t = tree;
+            while (t->right != 0) {
+                t = t->right;
+            }
+            largest = t->size;
+        } else if (bin_mask != 0) {
+            largest = (63 - __builtin_clzll(bin_mask)) * (uint64_t) BF_GRAIN;
+        } else if (zone.in_use < zone.size) {
+            largest = BF_GRAIN;
+        }
+    }
+    return grain_stats(&zone, st, largest);
+}
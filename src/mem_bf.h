@@ -0,0 +1,29 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef MEM_BF_H
+#define MEM_BF_H
+
+// Allocateur Best Fit (voir mem_bf.c). Par défaut, seule la variante
+// SUJET == 3 s'en sert ; mem_init_strategy(MEM_BF) ou ALLOCPHY_STRATEGY=bf
+// le sélectionnent à l'exécution.
+
+#include "mem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int bf_init(unsigned long pool_bytes);
+    void *bf_alloc(unsigned long size);
+    int bf_free(void *ptr, unsigned long size);
+    int bf_stats(struct mem_stats *st);
+    void *bf_pool();
+    int bf_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,222 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include "mem_cff.h"
+#include "mem_grain.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Circular First Fit
+//
+// Le pool est découpé en grains de CFF_GRAIN octets, avec des étiquettes de
+// frontière (voir mem_grain.h). Les tailles demandées sont arrondies au grain
+// supérieur. Comme mem_free reçoit la taille du bloc, un bloc alloué ne porte
+// aucune entête : toute sa place est rendue à l'utilisateur, et 8 blocs de
+// ALLOC_MEM_SIZE / 8 octets remplissent exactement le pool.
+//
+// Un bloc libre est chainé dans la liste free_list, circulaire, doublement
+// chainée et triée par adresse. À la libération, les voisins libres se
+// trouvent en temps constant grâce aux étiquettes. Seul un bloc sans voisin
+// libre doit chercher sa place dans la liste, en remontant foot_map jusqu'au
+// bloc libre qui le précède, 64 grains par mot.
+//
+// La recherche d'un bloc (next fit) part du bloc libre rover, là où la
+// recherche précédente s'est arrêtée, et fait au plus un tour de la liste.
+// Un bloc trop grand est coupé : le début est alloué et le reste prend sa
+// place dans la liste, et devient le nouveau rover.
+
+#define CFF_GRAIN 32
+
+struct cff_bloc {
+    uint64_t         size;  // En octets, entête et pied compris
+    struct cff_bloc *next;
+    struct cff_bloc *prev;
+    // ... puis le pied, un uint64_t égal à size, dans les 8 derniers octets
+};
+
+static struct grain_pool zone;
+static struct cff_bloc   free_list;     // Sentinelle, size vaut 0
+static struct cff_bloc  *rover = 0;
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Insère b dans la liste, juste après prev
+static void link_after(struct cff_bloc *prev, struct cff_bloc *b)
+{
+    b->prev = prev;
+    b->next = prev->next;
+    prev->next->prev = b;
+    prev->next = b;
+}
+
+static void unlink_bloc(struct cff_bloc *b)
+{
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+    if (rover == b) {
+        rover = b->next;
+    }
+}
+
+// Met b à la place de old dans la liste (b et old sont voisins, l'ordre des
+// adresses est donc conservé)
+static void replace_bloc(struct cff_bloc *old, struct cff_bloc *b)
+{
+    b->next = old->next;
+    b->prev = old->prev;
+    b->next->prev = b;
+    b->prev->next = b;
+    if (rover == old) {
+        rover = b;
+    }
+}
+
+// Retourne le bloc libre qui précède le grain g dans le pool, ou la
+// sentinelle s'il n'y en a pas
+static struct cff_bloc *prev_free(uint64_t g)
+{
+    uint64_t w, word;
+
+    if (g == 0) {
+        return &free_list;
+    }
+    w = (g - 1) >> 6;
+    word = zone.foot_map[w] & (~(uint64_t) 0 >> (63 - ((g - 1) & 63)));
+    while (word == 0) {
+        if (w == 0) {
+            return &free_list;
+        }
+        word = zone.foot_map[--w];
+    }
+    uint8_t *end = zone.base + ((w << 6) + 63 - __builtin_clzll(word) + 1) * CFF_GRAIN;
+    return (struct cff_bloc *) (end - FOOT(end, 0));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Début du pool, pour la trace (voir mem_trace.c)
+void *cff_pool()
+{
+    return zone.base;
+}
+
+int cff_destroy()
+{
+    grain_destroy(&zone);
+    return 0;
+}
+
+// Initialise un pool de pool_bytes octets (arrondi au grain inférieur),
+// formé d'un seul bloc libre
+int cff_init(unsigned long pool_bytes)
+{
+    if (grain_init(&zone, pool_bytes, CFF_GRAIN) != 0) {
+        return -1;
+    }
+    free_list.size = 0;
+    free_list.next = free_list.prev = &free_list;
+    grain_set_free(&zone, zone.base, zone.size);
+    link_after(&free_list, (struct cff_bloc *) zone.base);
+    rover = free_list.next;
+    return 0;
+}
+
+void *cff_alloc(unsigned long size)
+{
+    struct cff_bloc *b, *start;
+    uint64_t n;
+
+    if (zone.base == 0 || size == 0) {
+        return 0;
+    }
+    if (size > zone.size) {
+        zone.failed++;
+        return 0;
+    }
+    n = (size + CFF_GRAIN - 1) & ~(uint64_t) (CFF_GRAIN - 1);
+
+    // Un tour de la liste, en partant du rover et en sautant la sentinelle
+    b = start = rover;
+    do {
+        if (b != &free_list && b->size >= n) {
+            break;
+        }
+        b = b->next;
+    } while (b != start);
+    if (b == &free_list || b->size < n) {
+        zone.failed++;
+        return 0;
+    }
+
+    grain_clear_free(&zone, b);
+    if (b->size > n) {
+        struct cff_bloc *rest = (struct cff_bloc *) ((uint8_t *) b + n);
+        replace_bloc(b, rest);
+        grain_set_free(&zone, rest, b->size - n);
+        rover = rest;
+    } else {
+        unlink_bloc(b);
+        rover = b->next;
+    }
+    BIT_SET(zone.used_map, grain_of(&zone, b));
+    grain_count_alloc(&zone, n);
+    return b;
+}
+
+int cff_free(void *ptr, unsigned long size)
+{
+    struct cff_bloc *b = ptr, *left, *right;
+    uint64_t n, g;
+
+    n = (size + CFF_GRAIN - 1) & ~(uint64_t) (CFF_GRAIN - 1);
+    // Le bloc n'a pas d'entête : on vérifie que size est bien sa taille, pour
+    // ne pas rendre libre un voisin encore alloué
+    if (grain_check_used(&zone, ptr, n) != 0) {
+        return -1;
+    }
+    g = grain_of(&zone, ptr);
+    BIT_CLR(zone.used_map, g);
+    zone.in_use -= n;
+    left = grain_left_free(&zone, g);
+    right = grain_right_free(&zone, g, n);
+
+    if (left && right) {
+        // Le bloc comble le trou entre deux blocs libres
+        uint64_t total = left->size + n + right->size;
+        grain_clear_free(&zone, left);
+        grain_clear_free(&zone, right);
+        unlink_bloc(right);
+        grain_set_free(&zone, left, total);
+    } else if (left) {
+        uint64_t total = left->size + n;
+        grain_clear_free(&zone, left);
+        grain_set_free(&zone, left, total);
+    } else if (right) {
+        uint64_t total = n + right->size;
+        grain_clear_free(&zone, right);
+        replace_bloc(right, b);
+        grain_set_free(&zone, b, total);
+    } else {
+        link_after(prev_free(g), b);
+        grain_set_free(&zone, b, n);
+    }
+    return 0;
+}
+
+// Le plus grand bloc libre se cherche en parcourant la liste
+int cff_stats(struct mem_stats *st)
+{
+    uint64_t largest = 0;
+
+    if (zone.base != 0) {
+        for (struct cff_bloc *b = free_list.next; b != &free_list; b = b->next) {
+            if (b->size > largest) {
+                largest = b->size;
+            }
+        }
+    }
+    return grain_stats(&zone, st, largest);
+}
@@ -0,0 +1,29 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef MEM_CFF_H
+#define MEM_CFF_H
+
+// Allocateur Circular First Fit (voir mem_cff.c). mem_init le prend pour la
+// variante SUJET == 0 ou quand ALLOCPHY_STRATEGY vaut "cff", et
+// mem_init_strategy(MEM_CFF) le choisit dans n'importe quelle variante.
+
+#include "mem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int cff_init(unsigned long pool_bytes);
+    void *cff_alloc(unsigned long size);
+    int cff_free(void *ptr, unsigned long size);
+    int cff_stats(struct mem_stats *st);
+    void *cff_pool();
+    int cff_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
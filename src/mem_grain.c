@@ -0,0 +1,102 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <string.h>
+#include <sys/mman.h>
+#include "mem_grain.h"
+
+void *map_zone(uint64_t len)
+{
+    void *p = mmap(0, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? 0 : p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void grain_destroy(struct grain_pool *p)
+{
+    if (p->base) {
+        munmap(p->base, p->size);
+    }
+    if (p->head_map) {
+        munmap(p->head_map, 3 * p->map_words * sizeof(uint64_t));
+    }
+    p->base = 0;
+    p->head_map = p->foot_map = p->used_map = 0;
+    p->size = 0;
+}
+
+int grain_init(struct grain_pool *p, unsigned long pool_bytes, uint64_t grain)
+{
+    grain_destroy(p);
+    p->grain = grain;
+    p->size = pool_bytes - pool_bytes % grain;
+    if (p->size == 0) {
+        return -1;
+    }
+    p->map_words = (p->size / grain + 63) / 64;
+    p->base = map_zone(p->size);
+    p->head_map = map_zone(3 * p->map_words * sizeof(uint64_t));
+    if (p->base == 0 || p->head_map == 0) {
+        grain_destroy(p);
+        return -1;
+    }
+    p->foot_map = p->head_map + p->map_words;
+    p->used_map = p->foot_map + p->map_words;
+    p->in_use = p->peak = 0;
+    p->failed = 0;
+    return 0;
+}
+
+int grain_stats(struct grain_pool *p, struct mem_stats *st, uint64_t largest)
+{
+    memset(st, 0, sizeof(*st));
+    if (p->base == 0) {
+        return -1;
+    }
+    st->in_use = p->in_use;
+    st->peak = p->peak;
+    st->failed = p->failed;
+    st->mapped = p->size;
+    st->free_bytes = p->size - p->in_use;
+    st->largest_free = largest;
+    if (st->free_bytes != 0) {
+        st->fragmentation = 1.0 - (double) largest / st->free_bytes;
+    }
+    return 0;
+}
+
+// Le parcours des grains du bloc se fait 64 grains par mot
+int grain_check_used(struct grain_pool *p, void *ptr, uint64_t n)
+{
+    uint64_t g, from, end;
+
+    if (p->base == 0 || n == 0 || (uint8_t *) ptr < p->base
+        || (uint8_t *) ptr >= p->base + p->size
+        || ((uint8_t *) ptr - p->base) % p->grain != 0
+        || n > p->size - ((uint8_t *) ptr - p->base)) {
+        return -1;
+    }
+    g = grain_of(p, ptr);
+    if (!BIT_GET(p->used_map, g)) {
+        return -1;
+    }
+    end = g + n / p->grain;
+    for (from = g + 1; from < end; from = (from | 63) + 1) {
+        uint64_t mask = ~(uint64_t) 0 << (from & 63);
+        if (end - (from & ~(uint64_t) 63) < 64) {
+            mask &= ((uint64_t) 1 << (end & 63)) - 1;
+        }
+        if ((p->head_map[from >> 6] | p->used_map[from >> 6]) & mask) {
+            return -1;
+        }
+    }
+    if (end < p->size / p->grain && !BIT_GET(p->head_map, end)
+        && !BIT_GET(p->used_map, end)) {
+        return -1;
+    }
+    return 0;
+}
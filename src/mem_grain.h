@@ -0,0 +1,124 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef MEM_GRAIN_H
+#define MEM_GRAIN_H
+
+// Outils internes à liballocphy, communs à plusieurs allocateurs : la
+// projection de mémoire anonyme, et le pool découpé en grains avec ses
+// étiquettes de frontière, sur lequel reposent CFF (voir mem_cff.c) et Best
+// Fit (voir mem_bf.c).
+
+#include <stdint.h>
+#include "mem.h"
+
+// Réserve len octets de mémoire anonyme, ou renvoie 0. Les pages ne sont
+// réellement allouées (et mises à zéro) qu'au premier accès : un pool de
+// plusieurs dizaines de Gio et ses tableaux ne coûtent que ce qui est utilisé.
+void *map_zone(uint64_t len);
+
+//////////////////////////////////////////////////////////////////////////////
+// Pool découpé en grains
+//
+// Le pool de size octets est découpé en grains de grain octets (une
+// puissance de 2), et chaque bloc, libre ou alloué, est une suite de grains
+// contigus. Un bloc alloué ne porte aucune entête, un bloc libre porte sa
+// taille dans son premier uint64_t et dans son dernier (le pied). Comme un
+// bloc alloué peut contenir n'importe quoi, trois tableaux de bits, hors du
+// pool, disent pour chaque grain s'il commence un bloc libre (head_map),
+// s'il termine un bloc libre (foot_map) ou s'il commence un bloc alloué
+// (used_map). Les voisins libres d'un bloc se trouvent ainsi en temps
+// constant.
+
+struct grain_pool {
+    uint8_t  *base;
+    uint64_t  size;
+    uint64_t  grain;
+    uint64_t *head_map;
+    uint64_t *foot_map;
+    uint64_t *used_map;
+    uint64_t  map_words;
+    uint64_t  in_use;    // Octets des blocs alloués (voir grain_stats)
+    uint64_t  peak;
+    unsigned long failed;
+};
+
+#define BIT_SET(map, g) ((map)[(g) >> 6] |= (uint64_t) 1 << ((g) & 63))
+#define BIT_CLR(map, g) ((map)[(g) >> 6] &= ~((uint64_t) 1 << ((g) & 63)))
+#define BIT_GET(map, g) (((map)[(g) >> 6] >> ((g) & 63)) & 1)
+#define FOOT(b, size) (*(uint64_t *) ((uint8_t *) (b) + (size) - sizeof(uint64_t)))
+
+// Projette un pool de pool_bytes octets (arrondi au grain inférieur) et ses
+// tableaux de bits, tous à zéro. Retourne -1 en cas d'échec.
+int grain_init(struct grain_pool *p, unsigned long pool_bytes, uint64_t grain);
+void grain_destroy(struct grain_pool *p);
+
+// Remplit st avec les compteurs du pool. Tout ce qui n'est pas alloué est
+// dans un bloc libre, et largest est la taille du plus grand. Retourne -1 si
+// le pool n'est pas initialisé.
+int grain_stats(struct grain_pool *p, struct mem_stats *st, uint64_t largest);
+
+// Retourne 0 si le bloc de n octets (un multiple du grain) qui commence en
+// ptr est exactement un bloc alloué du pool, -1 sinon : ptr est dans le pool
+// et sur un grain, son bit de used_map est à 1, aucun bloc ne commence dans
+// ses autres grains et un bloc (ou la fin du pool) commence juste après lui.
+int grain_check_used(struct grain_pool *p, void *ptr, uint64_t n);
+
+// Compte les n octets d'un bloc qui vient d'être alloué
+static inline void grain_count_alloc(struct grain_pool *p, uint64_t n)
+{
+    p->in_use += n;
+    if (p->in_use > p->peak) {
+        p->peak = p->in_use;
+    }
+}
+
+// Numéro du grain de l'adresse ptr
+static inline uint64_t grain_of(struct grain_pool *p, void *ptr)
+{
+    return (uint64_t) ((uint8_t *) ptr - p->base) / p->grain;
+}
+
+// Écrit la taille du bloc libre b dans son entête et son pied, et marque son
+// premier et son dernier grain
+static inline void grain_set_free(struct grain_pool *p, void *b, uint64_t size)
+{
+    *(uint64_t *) b = size;
+    FOOT(b, size) = size;
+    BIT_SET(p->head_map, grain_of(p, b));
+    BIT_SET(p->foot_map, grain_of(p, b) + size / p->grain - 1);
+}
+
+// Efface les marques du bloc libre b
+static inline void grain_clear_free(struct grain_pool *p, void *b)
+{
+    BIT_CLR(p->head_map, grain_of(p, b));
+    BIT_CLR(p->foot_map, grain_of(p, b) + *(uint64_t *) b / p->grain - 1);
+}
+
+// Le bloc libre qui finit juste avant le grain g, ou 0
+static inline void *grain_left_free(struct grain_pool *p, uint64_t g)
+{
+    uint8_t *b = p->base + g * p->grain;
+
+    if (g == 0 || !BIT_GET(p->foot_map, g - 1)) {
+        return 0;
+    }
+    return b - FOOT(b, 0);
+}
+
+// Le bloc libre qui commence juste après les n octets à partir du grain g,
+// ou 0
+static inline void *grain_right_free(struct grain_pool *p, uint64_t g, uint64_t n)
+{
+    uint64_t next = g + n / p->grain;
+
+    if (next >= p->size / p->grain || !BIT_GET(p->head_map, next)) {
+        return 0;
+    }
+    return p->base + next * p->grain;
+}
+
+#endif
@@ -0,0 +1,280 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "mem.h"
+#include "mem_trace.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Trace binaire
+//
+// Chaque thread qui appelle l'allocateur pendant la trace écrit ses
+// enregistrements dans son propre anneau de TRACE_RING enregistrements, sans
+// verrou ni instruction atomique coûteuse : il est le seul à avancer head,
+// et le thread de vidage le seul à avancer tail. Un enregistrement coûte
+// donc une lecture du compteur de cycles et l'écriture de 32 octets. Si
+// l'anneau est plein, l'enregistrement est perdu et compté dans dropped :
+// l'allocateur n'attend jamais le disque.
+//
+// Le thread de vidage parcourt tous les anneaux toutes les TRACE_PERIOD_NS
+// nanosecondes et écrit leur contenu dans le fichier. Les anneaux ne sont
+// jamais libérés : celui d'un thread terminé est repris par le prochain
+// thread qui commence à tracer.
+//
+// Comme mem_init et mem_destroy, mem_trace_start et mem_trace_stop ne
+// doivent pas être appelées pendant que d'autres threads utilisent
+// l'allocateur.
+
+#ifdef MEM_TRACE
+
+#define TRACE_RING 16384
+#define TRACE_PERIOD_NS 1000000
+
+struct trace_ring {
+    struct trace_ring      *next;       // Liste de tous les anneaux
+    int                     owned;      // Rattaché à un thread vivant
+    uint32_t                thread;
+    uint64_t                head;
+    uint64_t                tail;
+    uint64_t                dropped;
+    struct mem_trace_record rec[TRACE_RING];
+};
+
+int mem_trace_on = 0;
+
+static struct trace_ring *rings = 0;
+static uint32_t           nb_threads = 0;
+static pthread_mutex_t    rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t      ring_key;
+static pthread_once_t     ring_key_once = PTHREAD_ONCE_INIT;
+static __thread struct trace_ring *ring = 0;
+
+static FILE      *trace_file = 0;
+static pthread_t  flusher;
+static int        stopping = 0;
+
+static uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Fréquence de ticks, mesurée sur 10 ms
+static uint64_t ticks_per_sec()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec pause = { 0, 10000000 };
+    uint64_t t0 = now_ns(), c0 = ticks(), t1, c1;
+
+    nanosleep(&pause, 0);
+    t1 = now_ns();
+    c1 = ticks();
+    return (c1 - c0) * 1000000000ULL / (t1 - t0);
+#else
+    return 1000000000ULL;
+#endif
+}
+
+// À la fin d'un thread, son anneau pourra être repris
+static void ring_release(void *arg)
+{
+    struct trace_ring *r = arg;
+    __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+// Rattache un anneau au thread courant : un anneau libéré s'il y en a,
+// sinon un nouveau
+static struct trace_ring *ring_get()
+{
+    struct trace_ring *r;
+
+    pthread_mutex_lock(&rings_lock);
+    for (r = rings; r != 0; r = r->next) {
+        if (!__atomic_load_n(&r->owned, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+    if (r == 0) {
+        r = mmap(0, sizeof(*r), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) {
+            pthread_mutex_unlock(&rings_lock);
+            return 0;
+        }
+        r->next = rings;
+        rings = r;
+    }
+    __atomic_store_n(&r->owned, 1, __ATOMIC_RELAXED);
+    r->thread = ++nb_threads;
+    pthread_mutex_unlock(&rings_lock);
+
+    pthread_once(&ring_key_once, ring_key_create);
+    pthread_setspecific(ring_key, r);
+    ring = r;
+    return r;
+}
+
+void mem_trace_event(uint32_t op, uint64_t size, uint64_t offset)
+{
+    struct trace_ring *r = ring;
+    struct mem_trace_record *rec;
+    uint64_t h;
+
+    if (r == 0 && (r = ring_get()) == 0) {
+        return;
+    }
+    h = r->head;
+    if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == TRACE_RING) {
+        r->dropped++;
+        return;
+    }
+    rec = &r->rec[h & (TRACE_RING - 1)];
+    rec->time = ticks();
+    rec->size = size;
+    rec->offset = offset;
+    rec->thread = r->thread;
+    rec->op = op;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+// Écrit dans le fichier le contenu de tous les anneaux
+static void trace_drain()
+{
+    struct trace_ring *r;
+
+    pthread_mutex_lock(&rings_lock);
+    r = rings;
+    pthread_mutex_unlock(&rings_lock);
+    // Les anneaux sont ajoutés en tête et jamais retirés
+    for (; r != 0; r = r->next) {
+        uint64_t h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t t = r->tail;
+        while (t != h) {
+            uint64_t start = t & (TRACE_RING - 1);
+            uint64_t nb = h - t;
+            if (nb > TRACE_RING - start) {
+                nb = TRACE_RING - start;
+            }
+            fwrite(&r->rec[start], sizeof(struct mem_trace_record), nb, trace_file);
+            t += nb;
+        }
+        __atomic_store_n(&r->tail, t, __ATOMIC_RELEASE);
+    }
+}
+
+static void *flusher_main(void *arg)
+{
+    struct timespec period = { 0, TRACE_PERIOD_NS };
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        trace_drain();
+        nanosleep(&period, 0);
+    }
+    return 0;
+}
+
+static void trace_atexit()
+{
+    mem_trace_stop();
+}
+
+// Commence à tracer les appels à l'allocateur dans le fichier path
+int mem_trace_start(const char *path)
+{
+    static int atexit_done = 0;
+    struct mem_trace_header hdr;
+
+    if (trace_file != 0 || (trace_file = fopen(path, "wb")) == 0) {
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MEM_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = MEM_TRACE_VERSION;
+    hdr.record_size = sizeof(struct mem_trace_record);
+    hdr.ticks_per_sec = ticks_per_sec();
+    fwrite(&hdr, sizeof(hdr), 1, trace_file);
+
+    // Les enregistrements d'une trace précédente sont oubliés
+    pthread_mutex_lock(&rings_lock);
+    for (struct trace_ring *r = rings; r != 0; r = r->next) {
+        r->tail = r->head;
+        r->dropped = 0;
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    stopping = 0;
+    if (pthread_create(&flusher, 0, flusher_main, 0) != 0) {
+        fclose(trace_file);
+        trace_file = 0;
+        return -1;
+    }
+    if (!atexit_done) {
+        atexit(trace_atexit);
+        atexit_done = 1;
+    }
+    __atomic_store_n(&mem_trace_on, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Arrête la trace, écrit ce qui reste dans les anneaux et ferme le fichier.
+// Retourne le nombre d'enregistrements perdus faute de place, ou -1 si
+// aucune trace n'était en cours.
+long mem_trace_stop()
+{
+    long dropped = 0;
+
+    if (trace_file == 0) {
+        return -1;
+    }
+    __atomic_store_n(&mem_trace_on, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher, 0);
+    trace_drain();
+    fclose(trace_file);
+    trace_file = 0;
+
+    pthread_mutex_lock(&rings_lock);
+    for (struct trace_ring *r = rings; r != 0; r = r->next) {
+        dropped += r->dropped;
+    }
+    pthread_mutex_unlock(&rings_lock);
+    return dropped;
+}
+
+#else
+
+int mem_trace_start(const char *path)
+{
+    return -1;
+}
+
+long mem_trace_stop()
+{
+    return -1;
+}
+
+#endif
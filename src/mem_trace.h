@@ -0,0 +1,64 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef MEM_TRACE_H
+#define MEM_TRACE_H
+
+// Trace binaire des appels à l'allocateur (voir mem_trace.c). Elle n'est
+// compilée que si MEM_TRACE est défini (option ALLOCPHY_TRACE de CMake) ;
+// sinon MEM_TRACE_EVENT ne produit aucun code et mem_trace_start échoue.
+//
+// Le fichier commence par une struct mem_trace_header, suivie des
+// enregistrements, par paquets d'un même thread : ils ne sont triés par
+// date qu'à l'intérieur d'un thread.
+
+#include <stdint.h>
+
+#define MEM_TRACE_MAGIC "ALLOCTRC"
+#define MEM_TRACE_VERSION 1
+
+// Valeurs de op
+#define MEM_TRACE_INIT 1        // size : taille du pool, offset : stratégie
+#define MEM_TRACE_ALLOC 2       // offset : MEM_TRACE_NULL si échec
+#define MEM_TRACE_FREE 3        // size : 0 pour mem_free_ptr
+#define MEM_TRACE_DESTROY 4
+#define MEM_TRACE_NULL (~(uint64_t) 0)
+
+struct mem_trace_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t ticks_per_sec;     // Unité de time
+};
+
+struct mem_trace_record {
+    uint64_t time;
+    uint64_t size;
+    uint64_t offset;            // Depuis le début du pool
+    uint32_t thread;            // Numéro du thread, à partir de 1
+    uint32_t op;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MEM_TRACE
+    extern int mem_trace_on;
+    void mem_trace_event(uint32_t op, uint64_t size, uint64_t offset);
+#define MEM_TRACE_EVENT(op, size, offset)                               \
+    do {                                                                \
+        if (__builtin_expect(mem_trace_on, 0)) {                        \
+            mem_trace_event((op), (size), (offset));                    \
+        }                                                               \
+    } while (0)
+#else
+#define MEM_TRACE_EVENT(op, size, offset) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,329 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "mem_wbuddy.h"
+#include "mem_grain.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Buddy pondéré (weighted buddy)
+//
+// Les tailles de blocs alternent entre les puissances de 2 et leurs trois
+// quarts : l'index 2k correspond à T(2k) = 2 puissance k, et l'index 2k + 1 à
+// T(2k + 1) = 3 * 2 puissance (k - 1), qui est entre T(2k) et T(2k + 2). Une
+// demande juste au-dessus d'une puissance de 2 ne perd donc plus qu'un quart
+// de son bloc au lieu de la moitié.
+//
+// Les découpages sont fixes :
+// - un bloc de taille 2 puissance k (index i pair) donne un bloc de gauche de
+//   3 * 2 puissance (k - 2) (index i - 1) et un bloc de droite de
+//   2 puissance (k - 2) (index i - 4) ;
+// - un bloc de taille 3 * 2 puissance k (index i impair) donne un bloc de
+//   gauche de 2 puissance (k + 1) (index i - 1) et un bloc de droite de
+//   2 puissance k (index i - 3).
+// Les blocs possibles forment donc un arbre fixe, dont la racine est le pool,
+// et un bloc est entièrement déterminé par son adresse et son index. Un bloc
+// qui n'est pas la racine ne sait pas de quel découpage il vient (un bloc de
+// 2 puissance k peut être le fils de gauche ou de droite selon ses ancêtres),
+// donc à la libération on retrouve le chemin depuis la racine en descendant
+// vers le bloc, ce qui demande au plus max_index étapes. On remonte ensuite ce
+// chemin tant que le frère du bloc est libre et entier.
+//
+// Comme pour le buddy, l'état des blocs est dans bloc_tag, un octet par
+// tranche de WB_GRAIN octets : TAG_FREE | i au début d'un bloc libre
+// d'index i, TAG_USED | i au début d'un bloc alloué. Un bloc dont le fils de
+// droite serait plus petit que T(min_index) n'est pas découpé : une demande
+// peut alors recevoir un bloc plus grand que T(index demandé), et c'est
+// bloc_tag qui dit à la libération quel bloc rendre.
+
+#define WB_GRAIN 16
+#define TAG_FREE 0x80
+#define TAG_USED 0x40
+#define TAG_ORDER 0x3f
+
+union wbloc {
+    struct {
+        union wbloc *next_record;
+        union wbloc *prev_record;
+    };
+    void *data;
+};
+
+static uint8_t    *pool = 0;
+static uint64_t    pool_size = 0;
+static int         max_index = 0;
+static int         min_index = 0;
+static union wbloc free_bloc[64];   // Sentinelles, une par index
+static uint64_t    free_mask = 0;
+static uint8_t    *bloc_tag = 0;
+static uint64_t    in_use = 0;     // Octets des blocs alloués (voir wbuddy_stats)
+static uint64_t    peak = 0;
+static unsigned long failed = 0;
+
+#define TAG(offset) (bloc_tag[(offset) / WB_GRAIN])
+
+// Taille des blocs d'index i
+static uint64_t wsize(int i)
+{
+    if (i & 1) {
+        return (uint64_t) 3 << ((i - 3) / 2);
+    }
+    return (uint64_t) 1 << (i / 2);
+}
+
+// Index du plus petit bloc de taille >= size
+static int windex(unsigned long size)
+{
+    int k = size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+    if (k >= 2 && size <= wsize(2 * k - 1)) {
+        return 2 * k - 1;
+    }
+    return 2 * k;
+}
+
+// Index du fils de droite d'un bloc d'index i (le fils de gauche est i - 1)
+static int right_index(int i)
+{
+    return (i & 1) ? i - 3 : i - 4;
+}
+
+static int splittable(int i)
+{
+    return right_index(i) >= min_index;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static void push_bloc(int i, uint64_t offset)
+{
+    union wbloc *b = (union wbloc *) (pool + offset);
+    b->next_record = free_bloc[i].next_record;
+    b->prev_record = &free_bloc[i];
+    b->next_record->prev_record = b;
+    free_bloc[i].next_record = b;
+    free_mask |= (uint64_t) 1 << i;
+    TAG(offset) = TAG_FREE | i;
+}
+
+static void remove_bloc(int i, uint64_t offset)
+{
+    union wbloc *b = (union wbloc *) (pool + offset);
+    b->prev_record->next_record = b->next_record;
+    b->next_record->prev_record = b->prev_record;
+    if (free_bloc[i].next_record == &free_bloc[i]) {
+        free_mask &= ~((uint64_t) 1 << i);
+    }
+    TAG(offset) = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+// Début du pool, pour la trace (voir mem_trace.c)
+void *wbuddy_pool()
+{
+    return pool;
+}
+
+int wbuddy_destroy()
+{
+    if (pool) {
+        munmap(pool, pool_size);
+    }
+    if (bloc_tag) {
+        munmap(bloc_tag, pool_size / WB_GRAIN);
+    }
+    pool = 0;
+    bloc_tag = 0;
+    pool_size = 0;
+    return 0;
+}
+
+// Initialise un pool de pool_bytes octets, arrondi à la puissance de 2
+// inférieure, formé d'un seul bloc libre. Un bloc libre doit pouvoir contenir
+// trois pointeurs.
+int wbuddy_init(unsigned long pool_bytes)
+{
+    wbuddy_destroy();
+    min_index = windex(3 * sizeof(void *));
+    if (pool_bytes < wsize(min_index)) {
+        return -1;
+    }
+    max_index = 2 * (63 - __builtin_clzll(pool_bytes));
+    // free_mask a 64 bits
+    if (max_index > 63) {
+        return -1;
+    }
+    pool_size = wsize(max_index);
+    pool = map_zone(pool_size);
+    bloc_tag = map_zone(pool_size / WB_GRAIN);
+    if (pool == 0 || bloc_tag == 0) {
+        wbuddy_destroy();
+        return -1;
+    }
+    for (int i = 0; i < 64; i++) {
+        free_bloc[i].next_record = &free_bloc[i];
+        free_bloc[i].prev_record = &free_bloc[i];
+    }
+    free_mask = 0;
+    push_bloc(max_index, 0);
+    in_use = peak = 0;
+    failed = 0;
+    return 0;
+}
+
+void *wbuddy_alloc(unsigned long size)
+{
+    uint64_t candidates, offset;
+    int t, i;
+
+    if (pool == 0 || size == 0) {
+        return 0;
+    }
+    if (size > pool_size) {
+        failed++;
+        return 0;
+    }
+    t = windex(size);
+    if (t < min_index) {
+        t = min_index;
+    }
+    candidates = free_mask & (~(uint64_t) 0 << t);
+    if (candidates == 0) {
+        failed++;
+        return 0;
+    }
+    i = __builtin_ctzll(candidates);
+    offset = (uint8_t *) free_bloc[i].next_record - pool;
+    remove_bloc(i, offset);
+
+    // On descend vers un bloc d'index t, par le fils de droite (le plus petit)
+    // s'il suffit, sinon par celui de gauche, en rendant l'autre fils libre
+    while (i > t && splittable(i)) {
+        int r = right_index(i);
+        uint64_t left_size = wsize(i - 1);
+        if (r >= t) {
+            push_bloc(i - 1, offset);
+            offset += left_size;
+            i = r;
+        } else {
+            push_bloc(r, offset + left_size);
+            i = i - 1;
+        }
+    }
+    TAG(offset) = TAG_USED | i;
+    in_use += wsize(i);
+    if (in_use > peak) {
+        peak = in_use;
+    }
+    return pool + offset;
+}
+
+int wbuddy_free(void *ptr, unsigned long size)
+{
+    uint64_t offset, path_offset[64], node;
+    int path_index[64], depth, i, t;
+
+    if (pool == 0 || size == 0 || (uint8_t *) ptr < pool
+        || (uint8_t *) ptr >= pool + pool_size) {
+        return -1;
+    }
+    offset = (uint8_t *) ptr - pool;
+    if (offset % WB_GRAIN != 0 || (TAG(offset) & (TAG_FREE | TAG_USED)) != TAG_USED) {
+        return -1;
+    }
+    i = TAG(offset) & TAG_ORDER;
+    t = windex(size);
+    if (t < min_index) {
+        t = min_index;
+    }
+    // size doit donner ce bloc-là : son index, ou un index plus petit si le
+    // bloc ne se découpe plus (voir wbuddy_alloc)
+    if (t > i || (t < i && splittable(i))) {
+        return -1;
+    }
+
+    // Chemin de la racine au bloc
+    depth = 0;
+    node = 0;
+    path_offset[0] = 0;
+    path_index[0] = max_index;
+    while (node != offset || path_index[depth] != i) {
+        int j = path_index[depth];
+        if (j <= i || !splittable(j)) {
+            return -1;
+        }
+        depth++;
+        if (offset >= node + wsize(j - 1)) {
+            node += wsize(j - 1);
+            path_index[depth] = right_index(j);
+        } else {
+            path_index[depth] = j - 1;
+        }
+        path_offset[depth] = node;
+    }
+    TAG(offset) = 0;
+    in_use -= wsize(i);
+
+    // Fusion avec le frère tant qu'il est libre
+    for (; depth > 0; depth--) {
+        uint64_t parent = path_offset[depth - 1];
+        int p = path_index[depth - 1];
+        uint64_t sibling;
+        int s;
+
+        if (path_offset[depth] == parent) {
+            sibling = parent + wsize(p - 1);
+            s = right_index(p);
+        } else {
+            sibling = parent;
+            s = p - 1;
+        }
+        if (TAG(sibling) != (TAG_FREE | s)) {
+            break;
+        }
+        remove_bloc(s, sibling);
+    }
+    push_bloc(path_index[depth], path_offset[depth]);
+    return 0;
+}
+
+// Comme wbuddy_free, mais la taille du bloc est lue dans bloc_tag
+int wbuddy_free_ptr(void *ptr)
+{
+    uint64_t offset;
+
+    if (pool == 0 || (uint8_t *) ptr < pool || (uint8_t *) ptr >= pool + pool_size) {
+        return -1;
+    }
+    offset = (uint8_t *) ptr - pool;
+    if (offset % WB_GRAIN != 0 || (TAG(offset) & (TAG_FREE | TAG_USED)) != TAG_USED) {
+        return -1;
+    }
+    return wbuddy_free(ptr, wsize(TAG(offset) & TAG_ORDER));
+}
+
+// Les blocs libres et alloués pavent tout le pool, et le plus grand bloc
+// libre est le premier de la liste d'index le plus haut
+int wbuddy_stats(struct mem_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    if (pool == 0) {
+        return -1;
+    }
+    st->in_use = in_use;
+    st->peak = peak;
+    st->failed = failed;
+    st->mapped = pool_size;
+    st->free_bytes = pool_size - in_use;
+    if (free_mask != 0) {
+        st->largest_free = wsize(63 - __builtin_clzll(free_mask));
+    }
+    if (st->free_bytes != 0) {
+        st->fragmentation = 1.0 - (double) st->largest_free / st->free_bytes;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#ifndef MEM_WBUDDY_H
+#define MEM_WBUDDY_H
+
+// Buddy pondéré (voir mem_wbuddy.c), l'allocateur de la variante SUJET == 2.
+// Les autres variantes l'obtiennent avec mem_init_strategy(MEM_WBUDDY), ou
+// avec ALLOCPHY_STRATEGY=wbuddy au premier mem_init.
+
+#include "mem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int wbuddy_init(unsigned long pool_bytes);
+    void *wbuddy_alloc(unsigned long size);
+    int wbuddy_free(void *ptr, unsigned long size);
+    int wbuddy_free_ptr(void *ptr);
+    int wbuddy_stats(struct mem_stats *st);
+    void *wbuddy_pool();
+    int wbuddy_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -8,8 +8,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mem.h"
+#include "mem_trace.h"
 
 /*
   ===============================================================================
@@ -22,15 +29,15 @@
 */
 
 /*
- * Nombre max de blocs alloues en meme temps
+ * Taille initiale de la table des blocs alloues (elle grandit a la demande)
  */
-#define NB_MAX_ALLOC 5000
+#define NB_MIN_ALLOC 64
 
 /*
  * Nombre de commandes differentes pour l'interpreteur
  * (sans inclure les commandes erronees (ERROR))
  */
-#define NB_CMD 8
+#define NB_CMD 9
 
 /*
  * Nombre de caracteres maximal pour une ligne de commande
@@ -53,7 +60,7 @@
  * On rajoute ERROR pour les commandes erronees
  */
 typedef enum { INIT =
-        0, SHOW, USED, ALLOC, FREE, DESTROY, HELP, EXIT, ERROR
+        0, SHOW, USED, ALLOC, FREE, DESTROY, STATS, HELP, EXIT, ERROR
 } COMMAND;
 
 /*
@@ -81,6 +88,8 @@ typedef struct {
     void *address;
     /* taille du bloc */
     size_t size;
+    /* si pas de bloc alloue : indice de la case libre suivante */
+    unsigned long next_free;
 } BLOCINFO;
 
 /*
@@ -100,15 +109,28 @@ unsigned long id_count;
  * Liste des commandes reconnues
  */
 static char *commands[NB_CMD] =
-    { "init", "show", "used", "alloc", "free", "destroy", "help", "exit" };
+    { "init", "show", "used", "alloc", "free", "destroy", "stats", "help",
+      "exit" };
 
 
 /*
- * Tableau stockant les infos sur les blocs alloues
- * Les recherches dans cette table se font sur le champ id
- * des structures BLOCINFO
+ * Tableau stockant les infos sur les blocs alloues, agrandi a la demande.
+ * Les cases libres sont chainees par leur champ next_free a partir de
+ * free_slot (NO_SLOT en fin de liste), et nb_slots cases ont deja servi.
+ * Les recherches par id passent par id_hash, table de hachage a adressage
+ * ouvert (sondage lineaire) qui contient l'indice de la case plus 1, 0 pour
+ * une entree vide ; elle est au plus a moitie pleine.
  */
-BLOCINFO bloc_info_table[NB_MAX_ALLOC];
+#define NO_SLOT (~0UL)
+
+BLOCINFO *bloc_info_table;
+unsigned long table_size;
+unsigned long nb_slots;
+unsigned long free_slot;
+unsigned long nb_live;
+
+unsigned long *id_hash;
+unsigned long hash_size;
 
 static void *zone_memoire;
 
@@ -130,7 +152,7 @@ void used()
 {
     unsigned long i;
 
-    for (i = 0; i < NB_MAX_ALLOC; i++) {
+    for (i = 0; i < nb_slots; i++) {
         if ((bloc_info_table[i]).id != 0) {
             printf("%ld 0x%lX 0x%lX\n",
                    bloc_info_table[i].id,
@@ -143,6 +165,34 @@ void used()
 }
 
 
+/*
+ * Affichage des statistiques de l'allocateur (voir mem_stats)
+ */
+void stats()
+{
+    struct mem_stats st;
+    int k;
+
+    if (mem_stats(&st) != 0) {
+        printf("Pas de statistiques pour cet allocateur\n");
+        return;
+    }
+    printf("occup : %lu octets (maximum %lu)\n", st.in_use, st.peak);
+    printf("projet : %lu octets, libre : %lu octets, en cache : %lu octets\n",
+           st.mapped, st.free_bytes, st.cached);
+    printf("plus grand bloc libre : %lu octets, fragmentation : %.3f\n",
+           st.largest_free, st.fragmentation);
+    printf("dcoupes : %lu, fusions : %lu, checs : %lu\n", st.splits,
+           st.merges, st.failed);
+    for (k = 0; k < 64; k++) {
+        if (st.free_blocks[k] != 0) {
+            printf("  2^%d : %lu blocs libres, %lu octets\n", k,
+                   st.free_blocks[k], st.free_blocks[k] << k);
+        }
+    }
+}
+
+
 /*
  * Affichage de l'aide
  */
@@ -163,14 +213,14 @@ void help()
     printf("5) used : affichage de la liste des blocs occups\n");
     printf
         ("\tsous la forme {identificateur, adresse de dpart, taille}\n");
-    printf("6) help : affichage de ce manuel\n");
-    printf("7) exit : quitter le shell\n");
+    printf("6) stats : affichage des statistiques de l'allocateur\n");
+    printf("7) help : affichage de ce manuel\n");
+    printf("8) exit : quitter le shell\n");
 
     printf("\nRemarques :\n");
     printf("1) Au lancement, le shell appelle mem_init\n");
     printf
-        ("2) Le shell supporte jusqu' %d allocations entre deux initialisations\n",
-         NB_MAX_ALLOC);
+        ("2) Le nombre de blocs allous n'est limit que par la mmoire\n");
 }
 
 
@@ -180,22 +230,23 @@ void help()
 void init()
 {
 
-    int i;
-
     printf("**** Mini-shell de test pour l'allocateur mmoire ****\n");
     printf("\tTapez help pour la liste des commandes\n");
 
     id_count = 1;
 
     /* initialisation de la memoire */
-    printf("Initialisation de la mmoire (%d octets)...", HEAP_SIZE);
+    printf("Initialisation de la mmoire (%lu octets)...", HEAP_SIZE);
     mem_init();
     printf("OK\n");
 
     /* initialisation de la table des infos : */
-    for (i = 0; i < NB_MAX_ALLOC; i++) {
-        (bloc_info_table[i]).id = 0;
-    }
+    free(bloc_info_table);
+    free(id_hash);
+    bloc_info_table = NULL;
+    id_hash = NULL;
+    table_size = nb_slots = nb_live = hash_size = 0;
+    free_slot = NO_SLOT;
 
     printf("\n");
 }
@@ -315,32 +366,131 @@ COMMAND read_command(ARG * args)
 }
 
 
+/*
+ * Case de id_hash ou commence la recherche de id
+ */
+static unsigned long hash_of(ID id)
+{
+    return (id * 0x9E3779B97F4A7C15UL) >> 32 & (hash_size - 1);
+}
+
+/*
+ * Range dans id_hash l'indice de case slot pour l'id de cette case
+ */
+static void hash_insert(unsigned long slot)
+{
+    unsigned long h = hash_of(bloc_info_table[slot].id);
+
+    while (id_hash[h] != 0) {
+        h = (h + 1) & (hash_size - 1);
+    }
+    id_hash[h] = slot + 1;
+}
+
+/*
+ * Double la taille de id_hash et y range de nouveau toutes les entrees
+ * retour : 0 si ok, -1 si plus de memoire
+ */
+static int hash_grow()
+{
+    unsigned long *old = id_hash, old_size = hash_size, h;
+
+    hash_size = old_size ? 2 * old_size : 2 * NB_MIN_ALLOC;
+    id_hash = calloc(hash_size, sizeof(*id_hash));
+    if (id_hash == NULL) {
+        id_hash = old;
+        hash_size = old_size;
+        return -1;
+    }
+    for (h = 0; h < old_size; h++) {
+        if (old[h] != 0) {
+            hash_insert(old[h] - 1);
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/*
+ * Case de id_hash qui contient id, ou NO_SLOT
+ */
+static unsigned long hash_find(ID id)
+{
+    unsigned long h;
+
+    if (hash_size == 0) {
+        return NO_SLOT;
+    }
+    for (h = hash_of(id); id_hash[h] != 0; h = (h + 1) & (hash_size - 1)) {
+        if (bloc_info_table[id_hash[h] - 1].id == id) {
+            return h;
+        }
+    }
+    return NO_SLOT;
+}
+
+/*
+ * Vide la case h de id_hash, en recalant les entrees suivantes de la meme
+ * sequence de sondage pour ne pas laisser de trou
+ */
+static void hash_remove(unsigned long h)
+{
+    unsigned long next = (h + 1) & (hash_size - 1);
+
+    while (id_hash[next] != 0) {
+        unsigned long home = hash_of(bloc_info_table[id_hash[next] - 1].id);
+        /* l'entree peut-elle aller en h ? (home hors de ]h, next]) */
+        if (((next - home) & (hash_size - 1)) >=
+            ((next - h) & (hash_size - 1))) {
+            id_hash[h] = id_hash[next];
+            h = next;
+        }
+        next = (next + 1) & (hash_size - 1);
+    }
+    id_hash[h] = 0;
+}
+
 /*
  * Obtient un identificateur a partir d'une adresse et d'une taille de bloc
  * et range les infos sur le bloc dans la table
  * addr : adresse du bloc
  * size : taille du bloc 
- * retour : un numero d'id ou 0 si plus d'id libre
+ * retour : un numero d'id ou 0 si plus de memoire pour la table
  */
 ID get_id(void *addr, size_t size)
 {
 
-    unsigned long index = 0;
+    unsigned long index;
 
-    while ((index < NB_MAX_ALLOC) && ((bloc_info_table[index]).id != 0)) {
-        index++;
+    if (2 * (nb_live + 1) > hash_size && hash_grow() != 0) {
+        return 0;
     }
 
-    if (index == NB_MAX_ALLOC) {        /* la limite d'allocation est atteinte */
-        return 0;
+    if (free_slot != NO_SLOT) {
+        index = free_slot;
+        free_slot = bloc_info_table[index].next_free;
     } else {
+        if (nb_slots == table_size) {   /* la table est pleine, on l'agrandit */
+            unsigned long new_size =
+                table_size ? 2 * table_size : NB_MIN_ALLOC;
+            BLOCINFO *t =
+                realloc(bloc_info_table, new_size * sizeof(BLOCINFO));
+            if (t == NULL) {
+                return 0;
+            }
+            bloc_info_table = t;
+            table_size = new_size;
+        }
+        index = nb_slots++;
+    }
 
-        bloc_info_table[index].id = id_count;
-        bloc_info_table[index].address = addr;
-        bloc_info_table[index].size = size;
+    bloc_info_table[index].id = id_count;
+    bloc_info_table[index].address = addr;
+    bloc_info_table[index].size = size;
+    hash_insert(index);
+    nb_live++;
 
-        return id_count++;      /* NB: on postincremente id_count */
-    }
+    return id_count++;          /* NB: on postincremente id_count */
 }
 
 
@@ -353,20 +503,19 @@ ID get_id(void *addr, size_t size)
 int get_info_from_id(ID id, void **addr, size_t * size)
 {
 
-    unsigned long index = 0;
+    unsigned long h, index;
 
     /* si id invalide, echec */
     if (id < 1)
         return -1;
 
-    while ((bloc_info_table[index].id != id) && (index < NB_MAX_ALLOC)) {
-        index++;
-    }
+    h = hash_find(id);
 
     /* si id non repertorie, echec */
-    if (index == NB_MAX_ALLOC)
+    if (h == NO_SLOT)
         return -1;
 
+    index = id_hash[h] - 1;
     *addr = bloc_info_table[index].address;
     *size = bloc_info_table[index].size;
 
@@ -382,18 +531,385 @@ int get_info_from_id(ID id, void **addr, size_t * size)
  */
 void remove_id(ID id)
 {
-    unsigned long index = 0;
-
-    while (bloc_info_table[index].id != id) {
-        index++;
-    }
+    unsigned long h = hash_find(id);
+    unsigned long index = id_hash[h] - 1;
 
+    hash_remove(h);
     bloc_info_table[index].id = 0;
     bloc_info_table[index].address = NULL;
+    bloc_info_table[index].next_free = free_slot;
+    free_slot = index;
+    nb_live--;
 }
 
+/*
+  ===============================================================================
+  Rejeu de traces
+  ===============================================================================
+*/
 
-int main()
+/*
+ * memshell -r <trace> rejoue une trace, sans interaction, contre mem_alloc et
+ * mem_free. La trace est soit un fichier binaire de mem_trace_start (voir
+ * mem_trace.h), soit un fichier texte de commandes du shell (init, alloc
+ * <taille>, free <identificateur>, les autres lignes tant ignores), les
+ * identificateurs tant numrots  partir de 1 dans l'ordre des alloc.
+ *
+ * La trace est projete en mmoire et traduite une fois pour toutes en un
+ * tableau d'oprations, o chaque libration dsigne l'allocation qu'elle
+ * dfait : le rejeu n'a ni analyse ni recherche  faire. Il est fait deux
+ * fois : une passe sans mesure pour le dbit, puis une passe qui mesure la
+ * latence de chaque appel.
+ */
+
+typedef struct {
+    int op;                     /* MEM_TRACE_INIT, ALLOC ou FREE */
+    uint64_t size;
+    uint64_t ref;               /* FREE : indice de l'allocation */
+} REPLAY_OP;
+
+typedef struct {
+    uint64_t key;               /* epoque puis offset (binaire) */
+    uint64_t offset;
+    uint64_t pos;
+} REPLAY_KEY;
+
+static REPLAY_OP *replay_ops;
+static uint64_t replay_nb;
+
+static int cmp_key(const void *a, const void *b)
+{
+    const REPLAY_KEY *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    if (x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static const struct mem_trace_record *sort_records;
+
+static int cmp_time(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    uint64_t tx = sort_records[x].time, ty = sort_records[y].time;
+    if (tx != ty)
+        return tx < ty ? -1 : 1;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Traduit une trace binaire : les enregistrements sont remis dans l'ordre
+ * des dates, puis chaque libration est rattache  l'allocation du mme
+ * offset qui la prcde, en triant par (poque, offset, position). Une
+ * poque commence  chaque init ou destroy.
+ */
+int load_binary(const char *data, size_t len)
+{
+    const struct mem_trace_header *hdr = (const void *) data;
+    const struct mem_trace_record *rec =
+        (const void *) (data + sizeof(*hdr));
+    uint64_t n, k, epoch = 0, nb_keys = 0;
+    uint64_t *order;
+    REPLAY_KEY *keys;
+
+    if (hdr->version != MEM_TRACE_VERSION
+        || hdr->record_size != sizeof(struct mem_trace_record))
+        return -1;
+    n = (len - sizeof(*hdr)) / sizeof(struct mem_trace_record);
+
+    order = malloc(n * sizeof(*order));
+    keys = malloc(n * sizeof(*keys));
+    replay_ops = malloc(n * sizeof(*replay_ops));
+    if (n > 0 && (order == NULL || keys == NULL || replay_ops == NULL)) {
+        free(order);
+        free(keys);
+        free(replay_ops);
+        replay_ops = NULL;
+        return -1;
+    }
+    for (k = 0; k < n; k++)
+        order[k] = k;
+    sort_records = rec;
+    qsort(order, n, sizeof(*order), cmp_time);
+
+    replay_nb = 0;
+    for (k = 0; k < n; k++) {
+        const struct mem_trace_record *r = &rec[order[k]];
+        REPLAY_OP *o = &replay_ops[replay_nb];
+
+        if (r->op == MEM_TRACE_INIT || r->op == MEM_TRACE_DESTROY) {
+            epoch++;
+            if (r->op == MEM_TRACE_DESTROY)
+                continue;
+        } else if (r->op == MEM_TRACE_ALLOC && r->offset == MEM_TRACE_NULL) {
+            /* une allocation qui avait chou n'a rien  rejouer */
+            continue;
+        } else if (r->op != MEM_TRACE_ALLOC && r->op != MEM_TRACE_FREE) {
+            continue;
+        }
+        o->op = r->op;
+        o->size = r->size;
+        o->ref = 0;
+        if (r->op != MEM_TRACE_INIT) {
+            keys[nb_keys].key = epoch;
+            keys[nb_keys].offset = r->offset;
+            keys[nb_keys].pos = replay_nb;
+            nb_keys++;
+        }
+        replay_nb++;
+    }
+
+    /* une libration suit l'allocation du mme bloc, sinon elle est ignore */
+    qsort(keys, nb_keys, sizeof(*keys), cmp_key);
+    for (k = 0; k < nb_keys; k++) {
+        REPLAY_OP *o = &replay_ops[keys[k].pos];
+        if (o->op != MEM_TRACE_FREE)
+            continue;
+        if (k > 0 && keys[k - 1].key == keys[k].key
+            && keys[k - 1].offset == keys[k].offset
+            && replay_ops[keys[k - 1].pos].op == MEM_TRACE_ALLOC) {
+            o->ref = keys[k - 1].pos;
+            o->size = replay_ops[o->ref].size;
+        } else {
+            o->op = 0;
+        }
+    }
+    free(order);
+    free(keys);
+    return 0;
+}
+
+/*
+ * Traduit une trace texte (commandes du shell)
+ */
+int load_text(const char *data, size_t len)
+{
+    const char *p = data, *end = data + len;
+    uint64_t *alloc_pos, nb_alloc = 0, max_ops = 1;
+    char line[MAX_CMD_SIZE];
+
+    for (p = data; p < end; p++)
+        max_ops += (*p == '\n');
+    replay_ops = malloc(max_ops * sizeof(*replay_ops));
+    alloc_pos = malloc(max_ops * sizeof(*alloc_pos));
+    if (replay_ops == NULL || alloc_pos == NULL) {
+        free(replay_ops);
+        free(alloc_pos);
+        replay_ops = NULL;
+        return -1;
+    }
+
+    replay_nb = 0;
+    for (p = data; p < end;) {
+        const char *eol = memchr(p, '\n', end - p);
+        size_t l = (eol ? eol : end) - p;
+        REPLAY_OP *o = &replay_ops[replay_nb];
+        char *arg;
+
+        if (l >= MAX_CMD_SIZE)
+            l = MAX_CMD_SIZE - 1;
+        memcpy(line, p, l);
+        line[l] = '\0';
+        p = eol ? eol + 1 : end;
+
+        o->size = 0;
+        o->ref = 0;
+        if (!strcmp(line, "init")) {
+            o->op = MEM_TRACE_INIT;
+        } else if (!strncmp(line, "alloc ", 6)) {
+            o->op = MEM_TRACE_ALLOC;
+            o->size = strtoul(line + 6, &arg, 0);
+            if (o->size == 0)
+                continue;
+            alloc_pos[nb_alloc++] = replay_nb;
+        } else if (!strncmp(line, "free ", 5)) {
+            unsigned long id = strtoul(line + 5, &arg, 10);
+            if (id == 0 || id > nb_alloc)
+                continue;
+            o->op = MEM_TRACE_FREE;
+            o->ref = alloc_pos[id - 1];
+            o->size = replay_ops[o->ref].size;
+        } else {
+            continue;
+        }
+        replay_nb++;
+    }
+    free(alloc_pos);
+    return 0;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Une passe de rejeu. Si lat n'est pas nul, la latence de chaque appel y
+ * est note, et les statistiques de l'allocateur sont releves dans at_peak
+ * quand les octets demands encore allous sont au plus haut (opration
+ * peak_op). La dure de la passe, sans le mem_init du dbut, est range
+ * dans elapsed. Retourne le nombre d'allocations qui ont chou.
+ */
+uint64_t replay_pass(void **ptrs, uint32_t * lat, uint64_t peak_op,
+                     struct mem_stats *at_peak, uint64_t * elapsed)
+{
+    uint64_t k, failed = 0, t0 = 0, overhead = 0, start;
+
+    if (lat != NULL) {
+        /* cot de la mesure elle-mme */
+        overhead = ~(uint64_t) 0;
+        for (k = 0; k < 1000; k++) {
+            uint64_t a = now_ns(), b = now_ns();
+            if (b - a < overhead)
+                overhead = b - a;
+        }
+    }
+    mem_init();
+    start = now_ns();
+    for (k = 0; k < replay_nb; k++) {
+        REPLAY_OP *o = &replay_ops[k];
+
+        if (lat != NULL)
+            t0 = now_ns();
+        switch (o->op) {
+        case MEM_TRACE_INIT:
+            if (k > 0)
+                mem_init();
+            break;
+        case MEM_TRACE_ALLOC:
+            ptrs[k] = mem_alloc(o->size);
+            failed += (ptrs[k] == NULL);
+            break;
+        case MEM_TRACE_FREE:
+            if (ptrs[o->ref] != NULL) {
+                mem_free(ptrs[o->ref], o->size);
+                ptrs[o->ref] = NULL;
+            }
+            break;
+        }
+        if (lat != NULL) {
+            uint64_t t = now_ns() - t0;
+            lat[k] = t > overhead ? t - overhead : 0;
+            if (k == peak_op)
+                mem_stats(at_peak);
+        }
+    }
+    *elapsed = now_ns() - start;
+    return failed;
+}
+
+/*
+ * Rejoue la trace path et affiche dbit, latences, occupation et
+ * fragmentation
+ */
+int replay(const char *path)
+{
+    struct stat st;
+    struct mem_stats at_peak, at_end;
+    const char *data;
+    void **ptrs;
+    uint32_t *lat;
+    uint64_t k, t, unused, failed, live = 0, peak = 0, peak_op = 0, nb_lat = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Erreur : impossible d'ouvrir %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    data = mmap(NULL, st.st_size > 0 ? st.st_size : 1, PROT_READ,
+                MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Erreur : impossible de projeter %s\n", path);
+        return 1;
+    }
+    if ((size_t) st.st_size >= sizeof(struct mem_trace_header)
+        && !memcmp(data, MEM_TRACE_MAGIC, 8) ? load_binary(data, st.st_size)
+        : load_text(data, st.st_size)) {
+        printf("Erreur : trace %s illisible\n", path);
+        munmap((void *) data, st.st_size > 0 ? st.st_size : 1);
+        return 1;
+    }
+    munmap((void *) data, st.st_size > 0 ? st.st_size : 1);
+
+    /* octets demands encore allous, d'aprs la trace */
+    for (k = 0; k < replay_nb; k++) {
+        if (replay_ops[k].op == MEM_TRACE_ALLOC)
+            live += replay_ops[k].size;
+        else if (replay_ops[k].op == MEM_TRACE_FREE)
+            live -= replay_ops[k].size;
+        else if (replay_ops[k].op == MEM_TRACE_INIT)
+            live = 0;
+        if (live > peak) {
+            peak = live;
+            peak_op = k;
+        }
+    }
+
+    ptrs = calloc(replay_nb + 1, sizeof(*ptrs));
+    lat = malloc((replay_nb + 1) * sizeof(*lat));
+    if (ptrs == NULL || lat == NULL) {
+        printf("Erreur : mmoire insuffisante\n");
+        free(ptrs);
+        free(lat);
+        free(replay_ops);
+        return 1;
+    }
+
+    failed = replay_pass(ptrs, NULL, 0, NULL, &t);
+    memset(ptrs, 0, replay_nb * sizeof(*ptrs));
+    memset(&at_peak, 0, sizeof(at_peak));
+    replay_pass(ptrs, lat, peak_op, &at_peak, &unused);
+    mem_stats(&at_end);
+    mem_destroy();
+
+    /* seules les allocations et librations comptent pour les latences */
+    for (k = 0; k < replay_nb; k++) {
+        if (replay_ops[k].op == MEM_TRACE_ALLOC
+            || replay_ops[k].op == MEM_TRACE_FREE)
+            lat[nb_lat++] = lat[k];
+    }
+    qsort(lat, nb_lat, sizeof(*lat), cmp_u32);
+
+    printf("Rejeu de %s : %lu oprations, %lu checs d'allocation\n", path,
+           (unsigned long) nb_lat, (unsigned long) failed);
+    printf("dbit : %.0f op/s (%.1f ns/op)\n",
+           t > 0 ? nb_lat * 1e9 / t : 0.0, nb_lat > 0 ? (double) t / nb_lat : 0.0);
+    if (nb_lat > 0) {
+        printf("latence (ns) : p50 %u, p90 %u, p99 %u, p99.9 %u, max %u\n",
+               lat[nb_lat / 2], lat[nb_lat * 9 / 10], lat[nb_lat * 99 / 100],
+               lat[nb_lat * 999 / 1000], lat[nb_lat - 1]);
+    }
+    printf("pic demand : %lu octets", (unsigned long) peak);
+    if (at_end.mapped != 0) {
+        printf(", pic allou : %lu octets, projet : %lu octets\n",
+               at_end.peak, at_end.mapped);
+        printf("fragmentation : %.3f au pic, %.3f  la fin\n",
+               at_peak.fragmentation, at_end.fragmentation);
+    } else {
+        printf("\n(pas de statistiques pour cet allocateur)\n");
+    }
+
+    free(ptrs);
+    free(lat);
+    free(replay_ops);
+    return 0;
+}
+
+
+int main(int argc, char **argv)
 {
     COMMAND cmd;
     ARG args = { 0, 0 };
@@ -401,6 +917,15 @@ int main()
     ID id;
     size_t size;
 
+    /* mode non interactif : memshell -r <trace> */
+    if (argc == 3 && !strcmp(argv[1], "-r")) {
+        return replay(argv[2]);
+    }
+    if (argc != 1) {
+        printf("usage : %s [-r <trace>]\n", argv[0]);
+        return 1;
+    }
+
     init();                     /* initialisation de l'interpreteur */
 
     while (1) {
@@ -415,7 +940,7 @@ int main()
 
         case INIT:
 
-            printf("Rinitialisation de la mmoire (%d octets)...",
+            printf("Rinitialisation de la mmoire (%lu octets)...",
                    HEAP_SIZE);
             mem_init();
             printf("OK\n");
@@ -423,7 +948,7 @@ int main()
 
         case SHOW:
             printf
-                ("Mmoire initialement disponible : %d octets dbutant en %p\n",
+                ("Mmoire initialement disponible : %lu octets dbutant en %p\n",
                  HEAP_SIZE, zone_memoire);
             break;
 
@@ -441,10 +966,10 @@ int main()
             } else {
                 id = get_id(res, args.size);
                 if (id == 0) {
-                    /* s'il ne reste pas d'id libre
+                    /* si la table ne peut plus grandir
                        on affiche 0 et on libere le bloc */
                     printf
-                        ("Erreur : nombre maximum d'allocations atteint/n");
+                        ("Erreur : plus de mmoire pour la table des blocs\n");
                     mem_free(res, args.size);
                 } else {        /* pas de probleme, affichage de la zone alloue */
                     printf("%ld 0x%lX\n", id,
@@ -457,6 +982,10 @@ int main()
             mem_destroy();
             break;
 
+        case STATS:
+            stats();
+            break;
+
         case FREE:
 
             if (get_info_from_id(args.id, &addr, &size) == -1)
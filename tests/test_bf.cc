@@ -7,6 +7,7 @@
 #include <gtest/gtest.h>
 
 #include "../src/mem.h"
+#include "../src/mem_bf.h"
 
 TEST( Variantes, bf ) {
   int multi = 0;
@@ -65,3 +66,82 @@ TEST( Variantes, bf ) {
 
   ASSERT_EQ(mem_free(tab[0], ALLOC_MEM_SIZE), 0);
 }
+
+// Appels directs à bf_alloc et bf_free, quelle que soit la variante : le
+// plus petit trou qui convient doit être choisi, qu'il soit dans une liste
+// ou dans l'arbre
+TEST( Variantes, bfbestfit ) {
+  const unsigned long P = 1UL << 20;
+  void *tab[8];
+
+  ASSERT_EQ( bf_init(P), 0 );
+  for (int i = 0; i < 8; i++) {
+    tab[i] = bf_alloc(i % 2 ? 100 : 3000 + 1000 * i);
+    ASSERT_NE( tab[i], (void *)0 );
+  }
+  // Trous de 3000, 5000 et 7000 octets, séparés par des blocs alloués
+  for (int i = 0; i < 6; i += 2)
+    ASSERT_EQ( bf_free(tab[i], 3000 + 1000 * i), 0 );
+  ASSERT_EQ( bf_alloc(4500), tab[2] );
+  ASSERT_EQ( bf_alloc(2000), tab[0] );
+  ASSERT_EQ( bf_alloc(7000), tab[4] );
+
+  // Petits trous de 112 octets, le dernier fusionne avec la fin du pool
+  for (int i = 1; i < 8; i += 2)
+    ASSERT_EQ( bf_free(tab[i], 100), 0 );
+  void *m = bf_alloc(112);
+  ASSERT_TRUE( m == tab[1] || m == tab[3] || m == tab[5] );
+  ASSERT_NE( bf_free(tab[7], 100), 0 );
+  ASSERT_EQ( bf_destroy(), 0 );
+
+  // Une taille fausse à la libération ne doit pas libérer les voisins
+  ASSERT_EQ( bf_init(P), 0 );
+  void *a = bf_alloc(1000);
+  void *b = bf_alloc(1000);
+  struct mem_stats st;
+  ASSERT_EQ( bf_alloc(2 * P), (void *)0 );
+  ASSERT_EQ( bf_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 2 * 1008UL );
+  ASSERT_EQ( st.failed, 1UL );
+  ASSERT_EQ( st.largest_free, P - 2 * 1008 );
+  ASSERT_EQ( st.fragmentation, 0.0 );
+  ASSERT_NE( bf_free(a, 2000), 0 );
+  ASSERT_NE( bf_free(a, 500), 0 );
+  ASSERT_NE( bf_alloc(2000), a );
+  ASSERT_EQ( bf_free(a, 1000), 0 );
+  ASSERT_EQ( bf_free(b, 1000), 0 );
+  ASSERT_EQ( bf_destroy(), 0 );
+  ASSERT_NE( bf_stats(&st), 0 );
+}
+
+TEST( Variantes, bfrandom ) {
+  const unsigned long P = 1UL << 20;
+  unsigned char *tab[512] = {};
+  unsigned long size[512];
+  unsigned int seed = 3;
+
+  ASSERT_EQ( bf_init(P), 0 );
+  for (int it = 0; it < 50000; it++) {
+    int k = rand_r(&seed) % 512;
+    if (tab[k]) {
+      ASSERT_EQ( tab[k][0], (unsigned char) k );
+      ASSERT_EQ( tab[k][size[k] - 1], (unsigned char) k );
+      ASSERT_EQ( bf_free(tab[k], size[k]), 0 );
+      tab[k] = 0;
+    } else {
+      size[k] = 1 + rand_r(&seed) % (k % 2 ? 600 : 6000);
+      tab[k] = (unsigned char *) bf_alloc(size[k]);
+      if (tab[k])
+        memset(tab[k], k, size[k]);
+    }
+  }
+  for (int k = 0; k < 512; k++)
+    if (tab[k])
+      ASSERT_EQ( bf_free(tab[k], size[k]), 0 );
+
+  // Tous les blocs libres ont fusionné
+  void *all = bf_alloc(P);
+  ASSERT_NE( all, (void *)0 );
+  ASSERT_EQ( bf_free(all, P), 0 );
+  ASSERT_EQ( bf_destroy(), 0 );
+}
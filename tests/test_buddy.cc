@@ -4,6 +4,8 @@
  * Ce code est distribué sous la licence GPLv3+.     *
  *****************************************************/
 
+#include <sys/mman.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 #include "../src/mem.h"
@@ -46,3 +48,516 @@ TEST(Variantes,buddy) {
   ASSERT_EQ( mem_free( mref, ALLOC_MEM_SIZE ), 0 );
   ASSERT_EQ( mem_destroy(), 0);
 }
+
+TEST(Variantes,buddycoalesce) {
+#ifndef BUDDY
+  return;
+#else
+  // Beaucoup de petits blocs libres dans la même liste, libérés dans un
+  // ordre qui ne fusionne qu'à la fin : tout doit se recoller.
+  const int nb = 4096;
+  static void *tab[nb];
+
+  ASSERT_EQ( mem_init(), 0 );
+  for(int i=0; i < nb; i++) {
+    tab[i] = mem_alloc(64);
+    ASSERT_NE( tab[i], (void *)0 );
+  }
+  for(int i=0; i < nb; i+=2)
+    ASSERT_EQ( mem_free( tab[i], 64 ), 0 );
+  ASSERT_NE( mem_free( tab[0], 64 ), 0 );
+  for(int i=1; i < nb; i+=2)
+    ASSERT_EQ( mem_free( tab[i], 64 ), 0 );
+
+  void *m1 = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m1, (void *)0 );
+  ASSERT_EQ( mem_free( m1, ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0);
+#endif
+}
+
+TEST(Variantes,buddyinitex) {
+#ifndef BUDDY
+  return;
+#else
+  // Un memory_pool de 64 Kio (70000 est arrondi), blocs de 64 octets minimum
+  ASSERT_EQ( mem_init_ex(70000, 6), 0 );
+
+  void *m1 = mem_alloc(1);
+  ASSERT_NE( m1, (void *)0 );
+  void *m2 = mem_alloc(1);
+  ASSERT_NE( m2, (void *)0 );
+  unsigned long v1 = (unsigned long) m1;
+  unsigned long v2 = (unsigned long) m2;
+  ASSERT_EQ( v1 ^ v2, 64UL );
+  ASSERT_EQ( mem_alloc(1 << 16), (void *)0 );
+  ASSERT_EQ( mem_free( m1, 1 ), 0 );
+  ASSERT_EQ( mem_free( m2, 1 ), 0 );
+
+  void *m3 = mem_alloc(1 << 16);
+  ASSERT_NE( m3, (void *)0 );
+  memset(m3, 5, 1 << 16);
+  ASSERT_EQ( mem_free( m3, 1 << 16 ), 0 );
+
+  ASSERT_NE( mem_init_ex(32, 6), 0 );
+
+  // mem_init revient à la taille compilée
+  ASSERT_EQ( mem_init(), 0 );
+  void *m4 = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m4, (void *)0 );
+  ASSERT_EQ( mem_free( m4, ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0);
+#endif
+}
+
+TEST(Variantes,buddylarge) {
+#ifndef BUDDY
+  return;
+#else
+  // 16 Gio réservés sans être touchés : seules les pages écrites existent
+  const unsigned long G = 1UL << 30;
+  ASSERT_EQ( mem_init_ex(16 * G, 12), 0 );
+
+  unsigned char *m1 = (unsigned char *) mem_alloc(8 * G);
+  ASSERT_NE( m1, (void *)0 );
+  unsigned char *m2 = (unsigned char *) mem_alloc(8 * G + 1);
+  ASSERT_EQ( m2, (void *)0 );
+  m2 = (unsigned char *) mem_alloc(4 * G);
+  ASSERT_NE( m2, (void *)0 );
+  unsigned char *m3 = (unsigned char *) mem_alloc(1);
+  ASSERT_NE( m3, (void *)0 );
+  m1[0] = m1[8 * G - 1] = 1;
+  m2[0] = m2[4 * G - 1] = 2;
+  m3[0] = 3;
+
+  // Les trois blocs sont à plus de 4 Gio les uns des autres
+  ASSERT_EQ( (unsigned long) (m2 > m1 ? m2 - m1 : m1 - m2), 8 * G );
+  ASSERT_GE( (unsigned long) (m3 > m1 ? m3 - m1 : m1 - m3), 8 * G );
+  ASSERT_EQ( m1[8 * G - 1], 1 );
+
+  ASSERT_EQ( mem_free( m3, 1 ), 0 );
+  ASSERT_EQ( mem_free( m2, 4 * G ), 0 );
+  ASSERT_EQ( mem_free( m1, 8 * G ), 0 );
+  void *m4 = mem_alloc(16 * G);
+  ASSERT_NE( m4, (void *)0 );
+  ASSERT_EQ( mem_free( m4, 16 * G ), 0 );
+
+  // En mode mono-thread, le nombre de blocs minimaux n'est pas limité à 2
+  // puissance 32 : 256 Gio avec la taille minimale par défaut
+  ASSERT_EQ( mem_init_ex(256 * G, 0), 0 );
+  m1 = (unsigned char *) mem_alloc(1);
+  ASSERT_NE( m1, (void *)0 );
+  m2 = (unsigned char *) mem_alloc(128 * G);
+  ASSERT_NE( m2, (void *)0 );
+  m1[0] = 1;
+  m2[128 * G - 1] = 2;
+  ASSERT_EQ( mem_free( m2, 128 * G ), 0 );
+  ASSERT_EQ( mem_free( m1, 1 ), 0 );
+  ASSERT_EQ( mem_destroy(), 0);
+#endif
+}
+
+TEST(Variantes,buddyelastic) {
+#ifndef BUDDY
+  return;
+#else
+  const unsigned long C = 1UL << 16;
+  void *tab[16];
+
+  // Chunks de 64 Kio, au plus 1 Mio, un seul projeté au départ
+  ASSERT_EQ( mem_init_elastic(C, 16 * C, 0), 0 );
+  ASSERT_EQ( mem_alloc(2 * C), (void *)0 );
+  for (int i = 0; i < 16; i++) {
+    tab[i] = mem_alloc(C);
+    ASSERT_NE( tab[i], (void *)0 );
+    memset(tab[i], i, C);
+  }
+  ASSERT_EQ( mem_alloc(1), (void *)0 );
+
+  // Chaque libération revient dans son propre chunk
+  for (int i = 0; i < 16; i += 2)
+    ASSERT_EQ( mem_free(tab[i], C), 0 );
+  for (int i = 0; i < 16; i += 2) {
+    void *m = mem_alloc(C / 2);
+    ASSERT_NE( m, (void *)0 );
+    ASSERT_EQ( mem_free(m, C / 2), 0 );
+  }
+  for (int i = 1; i < 16; i += 2)
+    ASSERT_EQ( mem_free(tab[i], C), 0 );
+  ASSERT_NE( mem_free(tab[1], C), 0 );
+
+  for (int i = 0; i < 16; i++) {
+    tab[i] = mem_alloc(C);
+    ASSERT_NE( tab[i], (void *)0 );
+  }
+  for (int i = 0; i < 16; i++)
+    ASSERT_EQ( mem_free(tab[i], C), 0 );
+  ASSERT_EQ( mem_destroy(), 0);
+#endif
+}
+
+TEST(Variantes,buddybacking) {
+#ifndef BUDDY
+  return;
+#else
+  ASSERT_NE( mem_set_backing(4), 0 );
+
+  // Pages énormes si le système en a, pages normales sinon : le memory_pool
+  // est aligné sur sa taille dans les deux cas
+  ASSERT_EQ( mem_set_backing(MEM_HUGEPAGE | MEM_POPULATE), 0 );
+  ASSERT_EQ( mem_init_ex(1UL << 22, 0), 0 );
+  void *p = mem_alloc(1UL << 22);
+  ASSERT_NE( p, (void *)0 );
+  ASSERT_EQ( (unsigned long) p & ((1UL << 22) - 1), 0UL );
+  memset(p, 1, 1UL << 22);
+  ASSERT_EQ( mem_free(p, 1UL << 22), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+
+  ASSERT_EQ( mem_set_backing(0), 0 );
+  ASSERT_EQ( mem_init(), 0 );
+  ASSERT_EQ( mem_hugetlb(), 0 );
+  p = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( p, (void *)0 );
+  ASSERT_EQ( (unsigned long) p & (ALLOC_MEM_SIZE - 1), 0UL );
+  ASSERT_EQ( mem_free(p, ALLOC_MEM_SIZE), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+// Nombre de pages en mémoire parmi les len octets qui suivent p
+static int resident_pages(void *p, unsigned long len)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned char vec[len / page];
+  int nb = 0;
+
+  if (mincore(p, len, vec) != 0)
+    return -1;
+  for (unsigned long i = 0; i < len / page; i++)
+    nb += vec[i] & 1;
+  return nb;
+}
+
+TEST(Variantes,buddypurge) {
+#ifndef BUDDY
+  return;
+#else
+  const unsigned long S = 1UL << 22;
+  const unsigned long page = sysconf(_SC_PAGESIZE);
+  unsigned long resident, purged;
+
+  // Un chunk neuf n'est pas encore en mémoire
+  ASSERT_EQ( mem_set_purge(0, 0), 0 );
+  ASSERT_EQ( mem_init_ex(S, 0), 0 );
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( purged, S - page );
+  ASSERT_EQ( resident, page );
+
+  // Sans purge, un bloc libéré reste en mémoire
+  void *p = mem_alloc(S / 2);
+  ASSERT_NE( p, (void *)0 );
+  memset(p, 1, S / 2);
+  ASSERT_EQ( mem_free(p, S / 2), 0 );
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( resident, S );
+  ASSERT_EQ( resident_pages((char *) p + page, S / 2 - page),
+             (int) ((S / 2 - page) / page) );
+
+  // mem_purge rend les pages, sauf la première du bloc
+  mem_purge();
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( resident, S );
+  ASSERT_EQ( mem_set_purge(16, 1UL << 20), 0 );
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( purged, S - page );
+  ASSERT_EQ( resident_pages((char *) p + page, S - page), 0 );
+
+  // Les blocs sales sous le seuil restent, le seuil dépassé purge tout
+  void *q[4];
+  for (int i = 0; i < 4; i++) {
+    q[i] = mem_alloc(S / 8);
+    ASSERT_NE( q[i], (void *)0 );
+    memset(q[i], 2, S / 8);
+  }
+  ASSERT_EQ( mem_free(q[0], S / 8), 0 );
+  ASSERT_EQ( mem_free(q[2], S / 8), 0 );
+  ASSERT_EQ( resident_pages((char *) q[2] + page, S / 8 - page),
+             (int) ((S / 8 - page) / page) );
+  ASSERT_EQ( mem_free(q[1], S / 8), 0 );
+  ASSERT_EQ( resident_pages((char *) q[2] + page, S / 8 - page), 0 );
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( resident, S / 8 + 3 * page );
+
+  // Purge immédiate
+  ASSERT_EQ( mem_set_purge(16, 0), 0 );
+  ASSERT_EQ( mem_free(q[3], S / 8), 0 );
+  ASSERT_EQ( mem_purge_stats(&resident, &purged), 0 );
+  ASSERT_EQ( purged, S - page );
+
+  // Les blocs restent utilisables
+  p = mem_alloc(S);
+  ASSERT_NE( p, (void *)0 );
+  memset(p, 3, S);
+  ASSERT_EQ( mem_free(p, S), 0 );
+  ASSERT_EQ( mem_set_purge(0, 0), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+TEST(Variantes,buddyfreeptr) {
+#ifndef BUDDY
+  return;
+#else
+  void *tab[10];
+
+  ASSERT_EQ( mem_init(), 0 );
+  for (int i = 0; i < 10; i++) {
+    tab[i] = mem_alloc(1UL << (2 * i));
+    ASSERT_NE( tab[i], (void *)0 );
+  }
+  // La taille est vérifiée, et un pointeur intérieur n'est pas un bloc
+  ASSERT_NE( mem_free(tab[9], 1UL << 17), 0 );
+  ASSERT_NE( mem_free_ptr((char *) tab[9] + 64), 0 );
+  ASSERT_NE( mem_free_ptr(0), 0 );
+  for (int i = 0; i < 10; i++)
+    ASSERT_EQ( mem_free_ptr(tab[i]), 0 );
+  ASSERT_NE( mem_free_ptr(tab[3]), 0 );
+  ASSERT_NE( mem_free(tab[3], 64), 0 );
+
+  // Tout a été fusionné
+  void *m = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m, (void *)0 );
+  ASSERT_EQ( mem_free_ptr(m), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+TEST(Variantes,buddyslab) {
+#ifndef BUDDY
+  return;
+#else
+  static void *tab[ALLOC_MEM_SIZE / 16];
+  unsigned long nb = 0;
+
+  ASSERT_NE( mem_set_slab(1024), 0 );
+  ASSERT_EQ( mem_set_slab(512), 0 );
+  ASSERT_EQ( mem_init(), 0 );
+
+  // Les objets de 24 octets sont rangés côte à côte
+  void *a = mem_alloc(24);
+  void *b = mem_alloc(24);
+  ASSERT_NE( a, (void *)0 );
+  ASSERT_EQ( (char *) b - (char *) a, 24 );
+  // 40 octets vont dans la classe de 48, pas dans un bloc de 64
+  void *c = mem_alloc(40);
+  void *d = mem_alloc(40);
+  ASSERT_EQ( (char *) d - (char *) c, 48 );
+  ASSERT_EQ( mem_free(c, 40), 0 );
+  ASSERT_NE( mem_free(c, 40), 0 );
+  ASSERT_NE( mem_free(d, 24), 0 );
+  ASSERT_NE( mem_free((char *) d + 8, 40), 0 );
+  ASSERT_NE( mem_free(d, 0), 0 );
+  void *zero[1] = { d };
+  unsigned long zero_size[1] = { 0 };
+  ASSERT_NE( mem_free_batch(zero, zero_size, 1), 0 );
+  ASSERT_EQ( mem_free_ptr(d), 0 );
+  ASSERT_NE( mem_free_ptr(d), 0 );
+  ASSERT_EQ( mem_free(a, 24), 0 );
+  ASSERT_EQ( mem_free(b, 24), 0 );
+
+  // Un pointeur hors du pool n'est pas pris pour un objet de slab
+  a = mem_alloc(24);
+  void *foreign = malloc(64);
+  ASSERT_NE( mem_free(foreign, 16), 0 );
+  ASSERT_NE( mem_free_ptr(foreign), 0 );
+  ASSERT_EQ( mem_realloc(foreign, 16, 32), (void *)0 );
+  void *out[1] = { foreign };
+  unsigned long sz[1] = { 16 };
+  ASSERT_NE( mem_free_batch(out, sz, 1), 0 );
+  free(foreign);
+  ASSERT_EQ( mem_free(a, 24), 0 );
+
+  // Le pool contient bien plus d'objets de 24 octets que de blocs de 32
+  while ((tab[nb] = mem_alloc(24)) != 0)
+    nb++;
+  ASSERT_GT( nb, ALLOC_MEM_SIZE / 32 );
+  for (unsigned long i = 0; i < nb; i++)
+    ASSERT_EQ( mem_free(tab[i], 24), 0 );
+
+  // Les slabs vides ont été rendus au buddy et fusionnés
+  void *m = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m, (void *)0 );
+  ASSERT_EQ( mem_free(m, ALLOC_MEM_SIZE), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+  ASSERT_EQ( mem_set_slab(0), 0 );
+#endif
+}
+
+TEST(Variantes,buddybatch) {
+#ifndef BUDDY
+  return;
+#else
+  static void *tab[ALLOC_MEM_SIZE / 64 + 16];
+  static unsigned long sizes[ALLOC_MEM_SIZE / 64 + 16];
+  unsigned long nb = ALLOC_MEM_SIZE / 64;
+
+  ASSERT_EQ( mem_init(), 0 );
+  // Les blocs d'un lot sont découpés dans un seul grand bloc
+  ASSERT_EQ( mem_alloc_batch(100, 64, tab), 100UL );
+  for (int k = 0; k < 100; k++) {
+    ASSERT_EQ( (char *) tab[k] - (char *) tab[0], 64 * k );
+    sizes[k] = 64;
+  }
+  // Le reste du grand bloc est toujours disponible
+  void *m = mem_alloc(ALLOC_MEM_SIZE / 2);
+  ASSERT_NE( m, (void *)0 );
+  ASSERT_EQ( mem_free(m, ALLOC_MEM_SIZE / 2), 0 );
+  // Un bloc libéré en double est refusé, les autres sont libérés
+  tab[100] = tab[3];
+  sizes[100] = 64;
+  ASSERT_NE( mem_free_batch(tab, sizes, 101), 0 );
+  ASSERT_NE( mem_free(tab[5], 64), 0 );
+
+  // Un lot trop grand s'arrête quand le pool est plein
+  ASSERT_EQ( mem_alloc_batch(nb + 16, 64, tab), nb );
+  ASSERT_EQ( mem_alloc(64), (void *)0 );
+  for (unsigned long k = 0; k < nb; k++)
+    sizes[k] = 64;
+  // Dans le désordre, par paquets
+  for (unsigned long k = 0; k < nb; k++) {
+    unsigned long r = (k * 2654435761UL) % nb;
+    void *t = tab[k];
+    tab[k] = tab[r];
+    tab[r] = t;
+  }
+  ASSERT_EQ( mem_free_batch(tab, sizes, nb), 0 );
+
+  // Tout a été fusionné
+  m = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m, (void *)0 );
+  ASSERT_EQ( mem_free(m, ALLOC_MEM_SIZE), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+TEST(Variantes,buddyaligned) {
+#ifndef BUDDY
+  return;
+#else
+  void *tab[8];
+
+  ASSERT_EQ( mem_init(), 0 );
+  ASSERT_EQ( mem_alloc_aligned(64, 0), (void *)0 );
+  ASSERT_EQ( mem_alloc_aligned(64, 96), (void *)0 );
+  ASSERT_EQ( mem_alloc_aligned(64, 2 * ALLOC_MEM_SIZE), (void *)0 );
+
+  // Le bloc est aligné, et seuls ses 64 octets sont pris au pool : le reste
+  // du bloc de 4096 octets sert aux allocations suivantes
+  void *a = mem_alloc(64);
+  void *b = mem_alloc_aligned(64, 4096);
+  ASSERT_NE( b, (void *)0 );
+  ASSERT_EQ( (uintptr_t) b % 4096, 0UL );
+  void *c = mem_alloc(64);
+  ASSERT_EQ( (char *) c - (char *) b, 64 );
+  ASSERT_EQ( mem_free(a, 64), 0 );
+  ASSERT_EQ( mem_free(c, 64), 0 );
+
+  for (int k = 0; k < 8; k++) {
+    unsigned long align = 1UL << (4 + 2 * k);
+    tab[k] = mem_alloc_aligned(100 * (k + 1), align);
+    ASSERT_NE( tab[k], (void *)0 );
+    ASSERT_EQ( (uintptr_t) tab[k] % align, 0UL );
+  }
+  ASSERT_EQ( mem_free(b, 64), 0 );
+  for (int k = 0; k < 8; k++)
+    ASSERT_EQ( mem_free(tab[k], 100 * (k + 1)), 0 );
+
+  // Le pool lui-même est aligné sur sa taille
+  void *m = mem_alloc_aligned(ALLOC_MEM_SIZE, ALLOC_MEM_SIZE);
+  ASSERT_NE( m, (void *)0 );
+  ASSERT_EQ( (uintptr_t) m % ALLOC_MEM_SIZE, 0UL );
+  ASSERT_EQ( mem_free(m, ALLOC_MEM_SIZE), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+TEST(Variantes,buddyrealloc) {
+#ifndef BUDDY
+  return;
+#else
+  ASSERT_EQ( mem_init(), 0 );
+  char *a = (char *) mem_realloc(0, 0, 64);
+  ASSERT_NE( a, (char *)0 );
+  memset(a, 'a', 64);
+
+  // Les compagnons de 64, 128, 256 et 512 octets sont libres
+  ASSERT_EQ( mem_realloc(a, 64, 1000), a );
+  ASSERT_NE( mem_free(a, 64), 0 );
+  for (int k = 0; k < 64; k++)
+    ASSERT_EQ( a[k], 'a' );
+  memset(a, 'b', 1000);
+
+  // Le compagnon de 1024 octets est pris : on copie
+  void *b = mem_alloc(1024);
+  ASSERT_EQ( (char *) b - a, 1024 );
+  char *c = (char *) mem_realloc(a, 1000, 4000);
+  ASSERT_NE( c, (char *)0 );
+  ASSERT_NE( c, a );
+  for (int k = 0; k < 1000; k++)
+    ASSERT_EQ( c[k], 'b' );
+  ASSERT_NE( mem_free(a, 1000), 0 );
+
+  // En rétrécissant, la fin du bloc retourne aux listes
+  ASSERT_EQ( mem_realloc(c, 4000, 100), c );
+  ASSERT_EQ( mem_alloc(128), c + 128 );
+  ASSERT_EQ( mem_free(c + 128, 128), 0 );
+  ASSERT_EQ( mem_realloc(c, 100, 0), (void *)0 );
+  ASSERT_NE( mem_free(c, 100), 0 );
+  ASSERT_EQ( mem_free(b, 1024), 0 );
+
+  // Un agrandissement impossible laisse le bloc alloué
+  a = (char *) mem_alloc(64);
+  ASSERT_EQ( mem_realloc(a, 64, 2 * ALLOC_MEM_SIZE), (void *)0 );
+  ASSERT_EQ( mem_realloc(a, 64, ALLOC_MEM_SIZE), a );
+  ASSERT_EQ( mem_free(a, ALLOC_MEM_SIZE), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+TEST(Variantes,buddystats) {
+#ifndef BUDDY
+  return;
+#else
+  struct mem_stats st;
+
+  ASSERT_EQ( mem_init(), 0 );
+  ASSERT_EQ( mem_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 0UL );
+  ASSERT_EQ( st.free_bytes, ALLOC_MEM_SIZE );
+  ASSERT_EQ( st.free_blocks[BUDDY_MAX_INDEX], 1UL );
+  ASSERT_EQ( st.fragmentation, 0.0 );
+
+  // Un bloc de 64 octets découpe le pool jusqu'à 2 puissance 6
+  void *a = mem_alloc(50);
+  void *b = mem_alloc(1000);
+  ASSERT_EQ( mem_alloc(2 * ALLOC_MEM_SIZE), (void *)0 );
+  ASSERT_EQ( mem_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 64UL + 1024 );
+  ASSERT_EQ( st.splits, (unsigned long) BUDDY_MAX_INDEX - 6 );
+  ASSERT_EQ( st.failed, 1UL );
+  ASSERT_EQ( st.free_bytes, ALLOC_MEM_SIZE - 64 - 1024 );
+  ASSERT_EQ( st.largest_free, ALLOC_MEM_SIZE / 2 );
+  for (int k = 6; k < BUDDY_MAX_INDEX; k++)
+    ASSERT_EQ( st.free_blocks[k], k == 10 ? 0UL : 1UL );
+  ASSERT_GT( st.fragmentation, 0.0 );
+
+  ASSERT_EQ( mem_free(a, 50), 0 );
+  ASSERT_EQ( mem_free(b, 1000), 0 );
+  ASSERT_EQ( mem_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 0UL );
+  ASSERT_EQ( st.peak, 64UL + 1024 );
+  ASSERT_EQ( st.merges, st.splits );
+  ASSERT_EQ( st.free_blocks[BUDDY_MAX_INDEX], 1UL );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
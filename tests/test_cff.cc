@@ -7,6 +7,7 @@
 #include <gtest/gtest.h>
 
 #include "../src/mem.h"
+#include "../src/mem_cff.h"
 
 TEST( Variantes, cff ) {
   int multi = 0;
@@ -61,3 +62,68 @@ TEST( Variantes, cff ) {
   ASSERT_EQ( mem_destroy(), 0);
 }
 
+
+// Parcours du rover et fusion des voisins libres, par cff_alloc et cff_free
+// sur un pool à part, avec des tailles quelconques
+TEST( Variantes, cffcoalesce ) {
+  const unsigned long P = 1UL << 20;
+  unsigned char *tab[256] = {};
+  unsigned long size[256];
+  unsigned int seed = 1;
+  struct mem_stats st;
+
+  ASSERT_EQ( cff_init(P), 0 );
+
+  // Le rover repart après le dernier bloc alloué, puis fait le tour
+  void *a = cff_alloc(1000);
+  void *b = cff_alloc(3000);
+  ASSERT_EQ( (char *) b, (char *) a + 1024 );
+  ASSERT_EQ( cff_alloc(2 * P), (void *)0 );
+  ASSERT_EQ( cff_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 1024UL + 3008 );
+  ASSERT_EQ( st.failed, 1UL );
+  ASSERT_EQ( st.free_bytes, P - 1024 - 3008 );
+  ASSERT_EQ( st.largest_free, st.free_bytes );
+  ASSERT_EQ( cff_free(a, 1000), 0 );
+  void *c = cff_alloc(500);
+  ASSERT_EQ( (char *) c, (char *) b + 3008 );
+  ASSERT_NE( cff_free(a, 1000), 0 );
+  // Une taille fausse à la libération ne doit pas libérer les voisins
+  ASSERT_NE( cff_free(b, 5000), 0 );
+  ASSERT_NE( cff_free(b, 1000), 0 );
+  ASSERT_EQ( cff_free(c, 500), 0 );
+  ASSERT_EQ( cff_free(b, 3000), 0 );
+  a = cff_alloc(1000);
+  b = cff_alloc(1000);
+  ASSERT_NE( cff_free(a, 2000), 0 );
+  ASSERT_EQ( cff_free(a, 1000), 0 );
+  ASSERT_EQ( cff_free(b, 1000), 0 );
+  ASSERT_EQ( cff_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 0UL );
+  ASSERT_EQ( st.peak, 1024UL + 3008 );
+  ASSERT_EQ( st.fragmentation, 0.0 );
+
+  for (int it = 0; it < 20000; it++) {
+    int k = rand_r(&seed) % 256;
+    if (tab[k]) {
+      for (unsigned long i = 0; i < size[k]; i += 97)
+        ASSERT_EQ( tab[k][i], (unsigned char) k );
+      ASSERT_EQ( cff_free(tab[k], size[k]), 0 );
+      tab[k] = 0;
+    } else {
+      size[k] = 1 + rand_r(&seed) % 9000;
+      tab[k] = (unsigned char *) cff_alloc(size[k]);
+      if (tab[k])
+        memset(tab[k], k, size[k]);
+    }
+  }
+  for (int k = 0; k < 256; k++)
+    if (tab[k])
+      ASSERT_EQ( cff_free(tab[k], size[k]), 0 );
+
+  // Tous les blocs libres ont fusionné
+  void *all = cff_alloc(P);
+  ASSERT_NE( all, (void *)0 );
+  ASSERT_EQ( cff_free(all, P), 0 );
+  ASSERT_EQ( cff_destroy(), 0 );
+}
@@ -182,3 +182,59 @@ TEST_F(BaseMemTest, aleatoire) {
       ASSERT_EQ( mem_free( m1, ALLOC_MEM_SIZE ), 0 );
     } 
 }
+
+// Toutes les stratégies sont dans la bibliothèque, quelle que soit la
+// variante compilée
+TEST(Init, strategies) {
+  for (int s = MEM_CFF; s <= MEM_BF; s++) {
+    ASSERT_EQ( mem_init_strategy(s), 0 );
+    ASSERT_EQ( mem_strategy(), s );
+    void *m1 = mem_alloc(ALLOC_MEM_SIZE);
+    ASSERT_NE( m1, (void *)0 );
+    memset(m1, s, ALLOC_MEM_SIZE);
+    ASSERT_EQ( mem_alloc(1), (void *)0 );
+    ASSERT_EQ( mem_free(m1, ALLOC_MEM_SIZE), 0 );
+    char *r = (char *) mem_realloc(0, 0, 100);
+    ASSERT_NE( r, (char *)0 );
+    memset(r, 7, 100);
+    r = (char *) mem_realloc(r, 100, 5000);
+    ASSERT_NE( r, (char *)0 );
+    ASSERT_EQ( r[99], 7 );
+    ASSERT_EQ( mem_realloc(r, 5000, 0), (void *)0 );
+    random_run_cpp(100, false);
+    ASSERT_EQ( mem_destroy(), 0 );
+  }
+  ASSERT_NE( mem_init_strategy(MEM_BF + 1), 0 );
+
+  // mem_init revient à la variante
+  ASSERT_EQ( mem_init(), 0 );
+  ASSERT_EQ( mem_strategy(), SUJET );
+
+  // Les extensions du buddy le choisissent
+  ASSERT_EQ( mem_init_ex(ALLOC_MEM_SIZE, 0), 0 );
+  ASSERT_EQ( mem_strategy(), MEM_BUDDY );
+  ASSERT_EQ( mem_destroy(), 0 );
+}
+
+// ALLOCPHY_STRATEGY n'est lue qu'au premier mem_init : ce test est relancé
+// par ctest avec la variable positionnée (voir CMakeLists.txt)
+TEST(Init, envstrategy) {
+  const char *name = getenv("ALLOCPHY_STRATEGY");
+
+  if (name == 0 || strcmp(name, "bf") == 0) {
+    ASSERT_EQ( mem_init(), 0 );
+    ASSERT_EQ( mem_strategy(), name ? MEM_BF : SUJET );
+    // Changer la variable ensuite est sans effet
+    ASSERT_EQ( setenv("ALLOCPHY_STRATEGY", "cff", 1), 0 );
+    ASSERT_EQ( mem_init(), 0 );
+    ASSERT_EQ( mem_strategy(), name ? MEM_BF : SUJET );
+    if (name == 0)
+      ASSERT_EQ( unsetenv("ALLOCPHY_STRATEGY"), 0 );
+    else
+      ASSERT_EQ( setenv("ALLOCPHY_STRATEGY", "bf", 1), 0 );
+  } else {
+    // Un nom inconnu fait échouer mem_init
+    ASSERT_NE( mem_init(), 0 );
+  }
+  mem_destroy();
+}
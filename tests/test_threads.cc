@@ -0,0 +1,347 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/mem.h"
+
+#define NB_THREADS 8
+#define NB_SLOTS 64
+#define NB_ITER 20000
+
+struct slot {
+  unsigned char *adr;
+  unsigned long size;
+};
+
+// Chaque thread alloue et libère au hasard des blocs qu'il remplit avec son
+// numéro. Si un bloc était donné à deux threads en même temps, l'un des deux
+// verrait son contenu modifié avant de le libérer. Les threads impairs
+// libèrent sans donner la taille.
+static int worker_free(long num, struct slot *s)
+{
+  return num & 1 ? mem_free_ptr(s->adr) : mem_free(s->adr, s->size);
+}
+
+static void *worker(void *arg)
+{
+  long num = (long) arg;
+  unsigned int seed = num;
+  struct slot slots[NB_SLOTS] = {};
+  long errors = 0;
+
+  for (int i = 0; i < NB_ITER; i++) {
+    struct slot *s = &slots[rand_r(&seed) % NB_SLOTS];
+    if (s->adr) {
+      for (unsigned long k = 0; k < s->size; k++)
+        if (s->adr[k] != (unsigned char) num)
+          errors++;
+      if (worker_free(num, s) != 0)
+        errors++;
+      s->adr = 0;
+    } else {
+      s->size = 1 + rand_r(&seed) % (rand_r(&seed) % 8 ? 512 : 8192);
+      s->adr = (unsigned char *) mem_alloc(s->size);
+      if (s->adr)
+        memset(s->adr, (unsigned char) num, s->size);
+    }
+  }
+  for (int i = 0; i < NB_SLOTS; i++)
+    if (slots[i].adr && worker_free(num, &slots[i]) != 0)
+      errors++;
+  return (void *) errors;
+}
+
+TEST(Threads, magazines) {
+#ifndef BUDDY
+  return;
+#else
+  pthread_t th[NB_THREADS];
+
+  ASSERT_EQ( mem_init_mt(), 0 );
+  for (long i = 0; i < NB_THREADS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, worker, (void *) i), 0 );
+  for (int i = 0; i < NB_THREADS; i++) {
+    void *errors;
+    ASSERT_EQ( pthread_join(th[i], &errors), 0 );
+    ASSERT_EQ( (long) errors, 0 );
+  }
+
+  // Les magasins des threads terminés sont revenus au buddy
+  void *m1 = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m1, (void *)0 );
+  ASSERT_EQ( mem_free( m1, ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+#define NB_ARENAS 4
+#define NB_BLOCS 256
+
+static void *produced[NB_ARENAS][NB_BLOCS];
+
+static void *producer(void *arg)
+{
+  long num = (long) arg;
+  for (int i = 0; i < NB_BLOCS; i++) {
+    produced[num][i] = mem_alloc(64 + 64 * (i % 4));
+    if (produced[num][i] == 0)
+      return (void *) 1;
+    memset(produced[num][i], (int) num, 64);
+  }
+  return 0;
+}
+
+// Libère les blocs alloués par le thread suivant, donc dans une autre arène
+static void *consumer(void *arg)
+{
+  long num = (long) arg;
+  long other = (num + 1) % NB_ARENAS;
+  for (int i = 0; i < NB_BLOCS; i++) {
+    if (mem_free(produced[other][i], 64 + 64 * (i % 4)) != 0)
+      return (void *) 1;
+  }
+  return 0;
+}
+
+TEST(Threads, remotefree) {
+#ifndef BUDDY
+  return;
+#else
+  pthread_t th[NB_ARENAS];
+  void *res;
+
+  ASSERT_EQ( mem_init_arenas(NB_ARENAS), 0 );
+  for (long i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, producer, (void *) i), 0 );
+  for (int i = 0; i < NB_ARENAS; i++) {
+    ASSERT_EQ( pthread_join(th[i], &res), 0 );
+    ASSERT_EQ( res, (void *)0 );
+  }
+  for (long i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, consumer, (void *) i), 0 );
+  for (int i = 0; i < NB_ARENAS; i++) {
+    ASSERT_EQ( pthread_join(th[i], &res), 0 );
+    ASSERT_EQ( res, (void *)0 );
+  }
+
+  // Une allocation plus grande qu'une arène est impossible
+  ASSERT_EQ( mem_alloc(ALLOC_MEM_SIZE + 1), (void *)0 );
+
+  // Toutes les files remote sont vidées et chaque arène est entière : chacune
+  // fait ALLOC_MEM_SIZE octets, quel que soit le nombre d'arènes
+  void *m[NB_ARENAS];
+  for (int i = 0; i < NB_ARENAS; i++) {
+    m[i] = mem_alloc(ALLOC_MEM_SIZE);
+    ASSERT_NE( m[i], (void *)0 );
+  }
+  ASSERT_EQ( mem_alloc(1), (void *)0 );
+  for (int i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( mem_free( m[i], ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+
+  // Même avec autant d'arènes que de processeurs
+  ASSERT_EQ( mem_init_arenas(0), 0 );
+  m[0] = mem_alloc(ALLOC_MEM_SIZE);
+  ASSERT_NE( m[0], (void *)0 );
+  ASSERT_EQ( mem_free( m[0], ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+static void *batch_producer(void *arg)
+{
+  long num = (long) arg;
+  if (mem_alloc_batch(NB_BLOCS, 128, produced[num]) != NB_BLOCS)
+    return (void *) 1;
+  for (int i = 0; i < NB_BLOCS; i++)
+    memset(produced[num][i], (int) num, 128);
+  return 0;
+}
+
+// Libère en un lot la moitié de ses blocs et la moitié de ceux du thread
+// suivant
+static void *batch_consumer(void *arg)
+{
+  long num = (long) arg;
+  long other = (num + 1) % NB_ARENAS;
+  void *ptrs[NB_BLOCS];
+  unsigned long sizes[NB_BLOCS];
+  for (int i = 0; i < NB_BLOCS / 2; i++) {
+    ptrs[2 * i] = produced[num][NB_BLOCS / 2 + i];
+    ptrs[2 * i + 1] = produced[other][i];
+    sizes[2 * i] = sizes[2 * i + 1] = 128;
+  }
+  return (void *) (long) (mem_free_batch(ptrs, sizes, NB_BLOCS) != 0);
+}
+
+TEST(Threads, batch) {
+#ifndef BUDDY
+  return;
+#else
+  pthread_t th[NB_ARENAS];
+  void *res;
+
+  ASSERT_EQ( mem_init_arenas(NB_ARENAS), 0 );
+  for (long i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, batch_producer, (void *) i), 0 );
+  for (int i = 0; i < NB_ARENAS; i++) {
+    ASSERT_EQ( pthread_join(th[i], &res), 0 );
+    ASSERT_EQ( res, (void *)0 );
+  }
+  for (long i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, batch_consumer, (void *) i), 0 );
+  for (int i = 0; i < NB_ARENAS; i++) {
+    ASSERT_EQ( pthread_join(th[i], &res), 0 );
+    ASSERT_EQ( res, (void *)0 );
+  }
+
+  // Les compteurs des threads ont été reportés à leur fin
+  struct mem_stats st;
+  ASSERT_EQ( mem_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 0UL );
+  ASSERT_EQ( st.peak, (unsigned long) NB_ARENAS * NB_BLOCS * 128 );
+  ASSERT_EQ( st.mapped, st.free_bytes + st.cached );
+
+  // Chaque arène est entière
+  void *m[NB_ARENAS];
+  for (int i = 0; i < NB_ARENAS; i++) {
+    m[i] = mem_alloc(ALLOC_MEM_SIZE);
+    ASSERT_NE( m[i], (void *)0 );
+  }
+  for (int i = 0; i < NB_ARENAS; i++)
+    ASSERT_EQ( mem_free( m[i], ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+#define STRESS_THREADS 8
+#define STRESS_ITER 50000
+
+// Un octet par tranche de 16 octets d'une zone de la taille du memory_pool
+// (une arène de ALLOC_MEM_SIZE octets par thread) : comme le memory_pool est
+// contigu, deux de ses blocs n'ont jamais le même indice.
+#define STRESS_POOL ((unsigned long) STRESS_THREADS * ALLOC_MEM_SIZE)
+static unsigned char in_use[STRESS_POOL / 16];
+static void *volatile exchange[STRESS_THREADS];
+
+static unsigned long use_index(void *p)
+{
+  return ((unsigned long) p / 16) % (STRESS_POOL / 16);
+}
+
+// Alloue et libère des petits blocs, dont une partie par un autre thread que
+// celui qui les a alloués. Un bloc donné deux fois est détecté par in_use,
+// et son contenu (adresse + numéro) est vérifié avant chaque libération.
+static void *stress(void *arg)
+{
+  long num = (long) arg;
+  unsigned int seed = num;
+  long errors = 0;
+
+  for (int i = 0; i < STRESS_ITER; i++) {
+    unsigned long size = 16 << (rand_r(&seed) % 5);
+    unsigned long *p = (unsigned long *) mem_alloc(size);
+    if (p == 0)
+      continue;
+    if (__atomic_exchange_n(&in_use[use_index(p)], 1, __ATOMIC_ACQ_REL) != 0)
+      errors++;
+    p[0] = (unsigned long) p;
+    p[1] = size;
+
+    // La moitié des blocs est échangée avec le thread voisin
+    if (rand_r(&seed) % 2)
+      p = (unsigned long *) __atomic_exchange_n(&exchange[(num + 1) % STRESS_THREADS],
+                                                p, __ATOMIC_ACQ_REL);
+    if (p == 0)
+      continue;
+    if (p[0] != (unsigned long) p)
+      errors++;
+    __atomic_store_n(&in_use[use_index(p)], 0, __ATOMIC_RELEASE);
+    if (mem_free(p, p[1]) != 0)
+      errors++;
+  }
+  return (void *) errors;
+}
+
+TEST(Threads, lockfreestress) {
+#ifndef BUDDY
+  return;
+#else
+  pthread_t th[STRESS_THREADS];
+
+  ASSERT_EQ( mem_init_arenas(STRESS_THREADS), 0 );
+  for (long i = 0; i < STRESS_THREADS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, stress, (void *) i), 0 );
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    void *errors;
+    ASSERT_EQ( pthread_join(th[i], &errors), 0 );
+    ASSERT_EQ( (long) errors, 0 );
+  }
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    unsigned long *p = (unsigned long *) exchange[i];
+    if (p) {
+      ASSERT_EQ( p[0], (unsigned long) p );
+      ASSERT_EQ( mem_free(p, p[1]), 0 );
+    }
+  }
+
+  // Aucun bloc perdu : chaque arène se reconstitue en entier
+  void *m[STRESS_THREADS];
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    m[i] = mem_alloc(ALLOC_MEM_SIZE);
+    ASSERT_NE( m[i], (void *)0 );
+  }
+  for (int i = 0; i < STRESS_THREADS; i++)
+    ASSERT_EQ( mem_free( m[i], ALLOC_MEM_SIZE ), 0 );
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
+
+#define GROW_THREADS 4
+#define GROW_BLOCS 16
+
+static void *grower(void *arg)
+{
+  long num = (long) arg;
+  void *tab[GROW_BLOCS];
+  long errors = 0;
+
+  for (int i = 0; i < GROW_BLOCS; i++) {
+    tab[i] = mem_alloc(32768);
+    if (tab[i] == 0)
+      return (void *) 1;
+    memset(tab[i], (int) num, 32768);
+  }
+  for (int i = 0; i < GROW_BLOCS; i++) {
+    if (((unsigned char *) tab[i])[32767] != (unsigned char) num)
+      errors++;
+    if (mem_free(tab[i], 32768) != 0)
+      errors++;
+  }
+  return (void *) errors;
+}
+
+TEST(Threads, elastic) {
+#ifndef BUDDY
+  return;
+#else
+  pthread_t th[GROW_THREADS];
+
+  // 2 chunks de 64 Kio au départ, les threads ont besoin de 2 Mio
+  ASSERT_EQ( mem_init_elastic(1 << 16, 1 << 22, 2), 0 );
+  for (long i = 0; i < GROW_THREADS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, grower, (void *) i), 0 );
+  for (int i = 0; i < GROW_THREADS; i++) {
+    void *errors;
+    ASSERT_EQ( pthread_join(th[i], &errors), 0 );
+    ASSERT_EQ( (long) errors, 0 );
+  }
+  ASSERT_EQ( mem_destroy(), 0 );
+#endif
+}
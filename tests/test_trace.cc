@@ -0,0 +1,86 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+#include "../src/mem.h"
+#include "../src/mem_trace.h"
+
+#define TRACE_THREADS 4
+#define TRACE_ITER 1000
+
+static void *tracer(void *arg)
+{
+  for (int i = 0; i < TRACE_ITER; i++) {
+    void *p = mem_alloc(64 + i % 100);
+    if (p == 0 || mem_free(p, 64 + i % 100) != 0)
+      return (void *) 1;
+  }
+  return 0;
+}
+
+TEST(Trace, binary) {
+  char path[] = "/tmp/alloctraceXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE( fd, 0 );
+  close(fd);
+
+#ifndef MEM_TRACE
+  // Sans l'option ALLOCPHY_TRACE, la trace n'existe pas
+  ASSERT_NE( mem_trace_start(path), 0 );
+  ASSERT_EQ( mem_trace_stop(), -1 );
+#else
+  pthread_t th[TRACE_THREADS];
+  void *res;
+
+  ASSERT_EQ( mem_init_mt(), 0 );
+  ASSERT_EQ( mem_trace_start(path), 0 );
+  ASSERT_NE( mem_trace_start(path), 0 );
+  void *a = mem_alloc(100);
+  ASSERT_NE( a, (void *)0 );
+  ASSERT_EQ( mem_free(a, 100), 0 );
+  for (long i = 0; i < TRACE_THREADS; i++)
+    ASSERT_EQ( pthread_create(&th[i], 0, tracer, (void *) i), 0 );
+  for (int i = 0; i < TRACE_THREADS; i++) {
+    ASSERT_EQ( pthread_join(th[i], &res), 0 );
+    ASSERT_EQ( res, (void *)0 );
+  }
+  // Un anneau plein perd des enregistrements, qui sont comptés
+  long dropped = mem_trace_stop();
+  ASSERT_GE( dropped, 0 );
+  ASSERT_EQ( mem_trace_stop(), -1 );
+  ASSERT_EQ( mem_destroy(), 0 );
+
+  FILE *f = fopen(path, "rb");
+  struct mem_trace_header hdr;
+  struct mem_trace_record rec;
+  unsigned long nb[TRACE_THREADS + 2] = { 0 };
+  uint64_t last[TRACE_THREADS + 2] = { 0 };
+  ASSERT_NE( f, (FILE *)0 );
+  ASSERT_EQ( fread(&hdr, sizeof(hdr), 1, f), 1UL );
+  ASSERT_EQ( memcmp(hdr.magic, MEM_TRACE_MAGIC, 8), 0 );
+  ASSERT_EQ( hdr.record_size, sizeof(rec) );
+  ASSERT_GT( hdr.ticks_per_sec, 0UL );
+  while (fread(&rec, sizeof(rec), 1, f) == 1) {
+    ASSERT_GE( rec.thread, 1U );
+    ASSERT_LE( rec.thread, (uint32_t) TRACE_THREADS + 1 );
+    ASSERT_TRUE( rec.op == MEM_TRACE_ALLOC || rec.op == MEM_TRACE_FREE );
+    ASSERT_LT( rec.offset, ALLOC_MEM_SIZE );
+    // Les enregistrements d'un thread sont dans l'ordre
+    ASSERT_GE( rec.time, last[rec.thread] );
+    last[rec.thread] = rec.time;
+    nb[rec.thread]++;
+  }
+  fclose(f);
+  unsigned long total = 0;
+  for (int t = 0; t < TRACE_THREADS + 2; t++)
+    total += nb[t];
+  ASSERT_EQ( total + dropped, 2UL + 2 * TRACE_THREADS * TRACE_ITER );
+#endif
+  unlink(path);
+}
@@ -0,0 +1,86 @@
+/*****************************************************
+ * This code is distributed under the GLPv3 licence. *
+ * Ce code est distribué sous la licence GPLv3+.     *
+ *****************************************************/
+
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include "../src/mem.h"
+#include "../src/mem_wbuddy.h"
+
+// Découpe d'un bloc en 3/4 + 1/4, puis 2/3 + 1/3, sans passer par mem_init
+TEST( Variantes, wbuddysplit ) {
+  const unsigned long P = 1UL << 20;
+  struct mem_stats st;
+
+  ASSERT_EQ( wbuddy_init(P), 0 );
+
+  // 1 Mio se coupe en 768 Kio + 256 Kio
+  void *a = wbuddy_alloc(3 * P / 4);
+  ASSERT_NE( a, (void *)0 );
+  void *b = wbuddy_alloc(P / 4);
+  ASSERT_EQ( (char *) b, (char *) a + 3 * P / 4 );
+  ASSERT_EQ( wbuddy_alloc(1), (void *)0 );
+  ASSERT_EQ( wbuddy_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, P );
+  ASSERT_EQ( st.free_bytes, 0UL );
+  ASSERT_EQ( st.failed, 1UL );
+  ASSERT_EQ( wbuddy_free(a, 3 * P / 4), 0 );
+
+  // 768 Kio se coupe en 512 Kio + 256 Kio
+  void *c = wbuddy_alloc(P / 4 + 1);
+  ASSERT_EQ( c, a );
+  void *d = wbuddy_alloc(P / 4);
+  ASSERT_EQ( (char *) d, (char *) a + P / 2 );
+  ASSERT_NE( wbuddy_free(d, P / 2), 0 );
+  ASSERT_NE( wbuddy_free(d, 10), 0 );
+  ASSERT_NE( wbuddy_free(d, P / 8), 0 );
+  ASSERT_NE( wbuddy_free(c, P / 4), 0 );
+  ASSERT_EQ( wbuddy_free(d, P / 4), 0 );
+  ASSERT_NE( wbuddy_free(d, P / 4), 0 );
+  ASSERT_EQ( wbuddy_free(c, P / 4 + 1), 0 );
+  ASSERT_EQ( wbuddy_free(b, P / 4), 0 );
+  ASSERT_EQ( wbuddy_stats(&st), 0 );
+  ASSERT_EQ( st.in_use, 0UL );
+  ASSERT_EQ( st.peak, P );
+  ASSERT_EQ( st.largest_free, P );
+
+  void *all = wbuddy_alloc(P);
+  ASSERT_EQ( all, a );
+  ASSERT_EQ( wbuddy_free(all, P), 0 );
+  ASSERT_EQ( wbuddy_destroy(), 0 );
+}
+
+TEST( Variantes, wbuddyrandom ) {
+  const unsigned long P = 1UL << 20;
+  unsigned char *tab[512] = {};
+  unsigned long size[512];
+  unsigned int seed = 2;
+
+  ASSERT_EQ( wbuddy_init(P), 0 );
+  for (int it = 0; it < 50000; it++) {
+    int k = rand_r(&seed) % 512;
+    if (tab[k]) {
+      ASSERT_EQ( tab[k][0], (unsigned char) k );
+      ASSERT_EQ( tab[k][size[k] - 1], (unsigned char) k );
+      ASSERT_EQ( wbuddy_free(tab[k], size[k]), 0 );
+      tab[k] = 0;
+    } else {
+      size[k] = 1 + rand_r(&seed) % 6000;
+      tab[k] = (unsigned char *) wbuddy_alloc(size[k]);
+      if (tab[k])
+        memset(tab[k], k, size[k]);
+    }
+  }
+  for (int k = 0; k < 512; k++)
+    if (tab[k])
+      ASSERT_EQ( wbuddy_free(tab[k], size[k]), 0 );
+
+  // Tous les blocs ont fusionné
+  void *all = wbuddy_alloc(P);
+  ASSERT_NE( all, (void *)0 );
+  ASSERT_EQ( wbuddy_free(all, P), 0 );
+  ASSERT_EQ( wbuddy_destroy(), 0 );
+}